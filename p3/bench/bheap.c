@@ -0,0 +1,436 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that p3Heap.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * bheap.c:
+ * Replays an allocation trace (see gentrace.c for the format) against
+ * balloc(), brealloc() and bfree() and reports:
+ *   ops/sec      ops replayed per second of time spent in the allocator
+ *   utilization  peak bytes of live payload over the peak footprint: the
+ *                span from the lowest to the highest heap block handed out,
+ *                at most the size of the heap, plus the bytes mapped for
+ *                blocks with their own mapping
+ *   latency      p50, p99 and worst time of a single op
+ *
+ * The heap can only be set up once per process, so each run replays one
+ * trace. With -r the replay is also captured to a log, which cap2trace
+ * turns back into a trace. With -P the trace is replayed once for each
+ * placement policy, each in a process of its own, and the results are
+ * printed side by side along with the fragmentation heap_stats() reports
+ * when the payload peaks. Traces free every block by the end, so the heap
+ * is no longer fragmented once the replay is done.
+ *
+ * With -T, a heap built with TRACE_METADATA writes every access to its own
+ * metadata during the replay to a trace that p4B/csim can simulate. The
+ * footprint is not tracked then, since heap_stats() would add its own
+ * accesses to the trace.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "p3Heap.h"
+
+typedef struct op {
+	char type;
+	int id;
+	size_t size;
+} op;
+
+/*
+ * What one replay measured
+ */
+typedef struct result {
+	double ops_per_sec;
+	double ns_per_op;
+	size_t peak_payload;
+	size_t peak_footprint;
+	long p50, p99, max;    // latencies in nanoseconds
+	double fragmentation;  // heap_stats() fragmentation at the peak payload
+} result;
+
+const char* policy_names[] = {"best", "first", "next", "good"};
+#define NUM_POLICIES 4
+
+/*
+ * Gets the current time
+ *
+ * retval: nanoseconds since some fixed point
+ */
+long nanoTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * Compares two latencies for qsort()
+ */
+int compareLong(const void* a, const void* b) {
+	long x = *(const long*)a;
+	long y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Prints the usage message and exits
+ *
+ * argv: the command line arguments
+ * status: the exit status, 0 for -h and 1 for a usage error
+ */
+void printUsage(char* argv[], int status) {
+	printf("Usage: %s [-hgctHP] [-p <policy>] [-s <size>] [-m <bytes>] [-r <log>] [-T <file>] <trace>\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h          Print this help message.\n");
+	printf("  -g          Let the heap grow, starting from 64 KiB.\n");
+	printf("  -c          Defer coalescing to coalesce().\n");
+	printf("  -t          Make the heap thread-safe.\n");
+	printf("  -H          Back the heap with huge pages.\n");
+	printf("  -p <policy> Placement policy: best (default), first, next or good.\n");
+	printf("  -P          Replay once per placement policy and compare them.\n");
+	printf("  -s <size>   Heap size instead of the one the trace suggests.\n");
+	printf("  -m <bytes>  Map requests of at least this size on their own.\n");
+	printf("  -r <log>    Capture every call to a log while replaying.\n");
+	printf("  -T <file>   Trace the heap's metadata accesses for csim while replaying.\n");
+	printf("\nExamples:\n");
+	printf("  linux>  %s -g traces/powerlaw.rep\n", argv[0]);
+	printf("  linux>  %s -P traces/phase.rep\n", argv[0]);
+	exit(status);
+}
+
+/*
+ * Sets up the heap and replays the ops against it
+ *
+ * ops: the ops of the trace
+ * num_ops: number of ops
+ * num_ids: number of block ids the ops use
+ * heap_size: size to set the heap up with
+ * mmap_threshold: the size set with set_mmap_threshold(), 0 if none
+ * capture: log to capture the replay to, NULL for none
+ * meta_trace: file to trace metadata accesses to, NULL for none
+ * res: filled in with what the replay measured
+ */
+void replay(op* ops, int num_ops, int num_ids, size_t heap_size,
+            size_t mmap_threshold, char* capture, char* meta_trace, result* res) {
+	void** blocks = calloc(num_ids, sizeof(void*));
+	size_t* sizes = calloc(num_ids, sizeof(size_t));
+	long* latency = malloc(num_ops * sizeof(long));
+	if (blocks == NULL || sizes == NULL || latency == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	if (init_heap(heap_size) != 0) {
+		exit(1);
+	}
+	if (capture != NULL && start_capture(capture) != 0) {
+		fprintf(stderr, "Error: cannot capture to %s\n", capture);
+		exit(1);
+	}
+	if (meta_trace != NULL && start_metadata_trace(meta_trace) != 0) {
+		fprintf(stderr, "Error: cannot trace to %s, is the heap built with TRACE_METADATA?\n",
+		        meta_trace);
+		exit(1);
+	}
+
+	size_t curr_payload = 0;
+	size_t peak_payload = 0;
+	size_t peak_footprint = 0;
+	char* lowest = NULL;
+	char* highest = NULL;
+	long total_time = 0;
+	res->fragmentation = 0;
+
+	for (int i = 0; i < num_ops; i++) {
+		int id = ops[i].id;
+		void* ptr = NULL;
+		long start = nanoTime();
+
+		switch (ops[i].type) {
+		case 'a':
+			ptr = balloc(ops[i].size);
+			//With deferred coalescing a failure is the time to merge
+			if (ptr == NULL && coalesce()) {
+				ptr = balloc(ops[i].size);
+			}
+			break;
+		case 'r':
+			ptr = brealloc(blocks[id], ops[i].size);
+			if (ptr == NULL && coalesce()) {
+				ptr = brealloc(blocks[id], ops[i].size);
+			}
+			break;
+		case 'f':
+			if (bfree(blocks[id]) != 0) {
+				fprintf(stderr, "Error: op %d could not free id %d\n", i, id);
+				exit(1);
+			}
+			break;
+		default:
+			fprintf(stderr, "Error: unknown op %c\n", ops[i].type);
+			exit(1);
+		}
+
+		latency[i] = nanoTime() - start;
+		total_time += latency[i];
+
+		//The first byte of every block holds its id, which catches
+		//blocks that overlap or lose their contents
+		if (ops[i].type == 'f') {
+			curr_payload -= sizes[id];
+			blocks[id] = NULL;
+			continue;
+		}
+		if (ptr == NULL) {
+			fprintf(stderr, "Error: op %d (%c %d %zu) ran out of memory\n",
+			        i, ops[i].type, id, ops[i].size);
+			exit(1);
+		}
+		if (ops[i].type == 'r' && *(unsigned char*)ptr != (unsigned char)id) {
+			fprintf(stderr, "Error: op %d lost the contents of id %d\n", i, id);
+			exit(1);
+		}
+		*(unsigned char*)ptr = id;
+		curr_payload += ops[i].size - sizes[id];
+		sizes[id] = ops[i].size;
+		blocks[id] = ptr;
+		if (meta_trace != NULL) {
+			continue;
+		}
+
+		//Mapped blocks lie outside the heap, so they are counted apart
+		if (mmap_threshold == 0 || ops[i].size < mmap_threshold) {
+			char* end = (char*)ptr + balloc_usable_size(ptr);
+			if (lowest == NULL || (char*)ptr < lowest) {
+				lowest = ptr;
+			}
+			if (end > highest) {
+				highest = end;
+			}
+		}
+		heapStats stats;
+		heap_stats(&stats);
+		if (curr_payload > peak_payload) {
+			peak_payload = curr_payload;
+			res->fragmentation = stats.fragmentation;
+		}
+		//Heap regions need not be next to each other once it has grown
+		size_t footprint = highest - lowest;
+		if (footprint > stats.heap_size) {
+			footprint = stats.heap_size;
+		}
+		if (footprint + stats.mapped_size > peak_footprint) {
+			peak_footprint = footprint + stats.mapped_size;
+		}
+	}
+
+	if (capture != NULL) {
+		stop_capture();
+	}
+	if (meta_trace != NULL) {
+		stop_metadata_trace();
+	}
+
+	qsort(latency, num_ops, sizeof(long), compareLong);
+	res->ops_per_sec = total_time > 0 ? num_ops * 1e9 / total_time : 0;
+	res->ns_per_op = num_ops > 0 ? (double)total_time / num_ops : 0;
+	res->peak_payload = peak_payload;
+	res->peak_footprint = peak_footprint;
+	if (num_ops > 0) {
+		res->p50 = latency[num_ops / 2];
+		res->p99 = latency[num_ops * 99 / 100];
+		res->max = latency[num_ops - 1];
+	}
+
+	free(blocks);
+	free(sizes);
+	free(latency);
+}
+
+/*
+ * Gets the utilization of a replay
+ *
+ * retval: peak payload over peak footprint, in percent
+ */
+double utilization(result* res) {
+	return res->peak_footprint > 0 ? 100.0 * res->peak_payload / res->peak_footprint : 0;
+}
+
+/*
+ * Replays the ops once per placement policy, each time in a child process
+ * since the heap can only be set up once, and prints a row per policy
+ *
+ * retval: 0 if every replay succeeded, 1 otherwise
+ */
+int comparePolicies(op* ops, int num_ops, int num_ids, size_t heap_size,
+                    size_t mmap_threshold, char* trace) {
+	int failed = 0;
+
+	printf("trace        %s\n", trace);
+	printf("ops          %d\n", num_ops);
+	printf("%-8s %12s %10s %8s %8s %12s\n",
+	       "policy", "ops/sec", "ns/op", "p99 ns", "util", "frag");
+	for (int policy = 0; policy < NUM_POLICIES; policy++) {
+		int fds[2];
+		result res;
+		if (pipe(fds) != 0) {
+			fprintf(stderr, "Error: cannot make a pipe\n");
+			exit(1);
+		}
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "Error: cannot fork\n");
+			exit(1);
+		}
+		if (pid == 0) {
+			close(fds[0]);
+			set_placement_policy(policy);
+			replay(ops, num_ops, num_ids, heap_size, mmap_threshold, NULL, NULL, &res);
+			if (write(fds[1], &res, sizeof(res)) != sizeof(res)) {
+				exit(1);
+			}
+			exit(0);
+		}
+
+		close(fds[1]);
+		int status;
+		ssize_t got = read(fds[0], &res, sizeof(res));
+		close(fds[0]);
+		waitpid(pid, &status, 0);
+		if (got != sizeof(res) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			printf("%-8s failed\n", policy_names[policy]);
+			failed = 1;
+			continue;
+		}
+		printf("%-8s %12.0f %10.1f %8ld %7.1f%% %11.1f%%\n",
+		       policy_names[policy], res.ops_per_sec, res.ns_per_op, res.p99,
+		       utilization(&res), 100 * res.fragmentation);
+	}
+	return failed;
+}
+
+int main(int argc, char* argv[]) {
+	size_t heap_size = 0;
+	size_t mmap_threshold = 0;
+	char* capture = NULL;
+	char* meta_trace = NULL;
+	int grow = 0;
+	int compare = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "hgctHPp:s:m:r:T:")) != -1) {
+		switch (c) {
+		case 'g':
+			grow = 1;
+			set_heap_growth(1);
+			break;
+		case 'c':
+			set_coalesce_mode(COALESCE_DEFERRED);
+			break;
+		case 't':
+			set_thread_safe(1);
+			break;
+		case 'H':
+			set_huge_pages(1);
+			break;
+		case 'P':
+			compare = 1;
+			break;
+		case 'p': {
+			int policy = 0;
+			while (policy < NUM_POLICIES && strcmp(optarg, policy_names[policy]) != 0) {
+				policy++;
+			}
+			if (policy == NUM_POLICIES) {
+				printUsage(argv, 1);
+			}
+			set_placement_policy(policy);
+			break;
+		}
+		case 's':
+			heap_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			mmap_threshold = strtoul(optarg, NULL, 0);
+			set_mmap_threshold(mmap_threshold);
+			break;
+		case 'r':
+			capture = optarg;
+			break;
+		case 'T':
+			meta_trace = optarg;
+			break;
+		case 'h':
+			printUsage(argv, 0);
+		default:
+			printUsage(argv, 1);
+		}
+	}
+	if (optind != argc - 1 || (compare && (capture != NULL || meta_trace != NULL))) {
+		printUsage(argv, 1);
+	}
+
+	FILE* trace = fopen(argv[optind], "r");
+	if (trace == NULL) {
+		fprintf(stderr, "Error: cannot open %s\n", argv[optind]);
+		exit(1);
+	}
+
+	//Read the header and every op before touching the heap
+	size_t suggested;
+	int num_ids, num_ops, weight;
+	if (fscanf(trace, "%zu %d %d %d", &suggested, &num_ids, &num_ops, &weight) != 4 ||
+	    num_ids < 0 || num_ops < 0) {
+		fprintf(stderr, "Error: %s has a bad header\n", argv[optind]);
+		exit(1);
+	}
+	op* ops = malloc(num_ops * sizeof(op));
+	if (ops == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	for (int i = 0; i < num_ops; i++) {
+		char type[2];
+		if (fscanf(trace, "%1s %d", type, &ops[i].id) != 2 ||
+		    ops[i].id < 0 || ops[i].id >= num_ids ||
+		    (type[0] != 'f' && fscanf(trace, "%zu", &ops[i].size) != 1)) {
+			fprintf(stderr, "Error: bad op %d in %s\n", i, argv[optind]);
+			exit(1);
+		}
+		ops[i].type = type[0];
+	}
+	fclose(trace);
+
+	if (heap_size == 0) {
+		heap_size = grow ? 64 * 1024 : suggested;
+	}
+	if (compare) {
+		int failed = comparePolicies(ops, num_ops, num_ids, heap_size,
+		                             mmap_threshold, argv[optind]);
+		free(ops);
+		return failed;
+	}
+
+	result res;
+	replay(ops, num_ops, num_ids, heap_size, mmap_threshold, capture, meta_trace, &res);
+	printf("trace        %s\n", argv[optind]);
+	printf("ops          %d\n", num_ops);
+	printf("ops/sec      %.0f\n", res.ops_per_sec);
+	printf("utilization  %.1f%% (%zu payload / %zu footprint bytes)\n",
+	       utilization(&res), res.peak_payload, res.peak_footprint);
+	if (num_ops > 0) {
+		printf("latency      p50 %ld ns, p99 %ld ns, max %ld ns\n",
+		       res.p50, res.p99, res.max);
+	}
+
+	free(ops);
+	return 0;
+}
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that p3Heap.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * bwalk.c:
+ * Times the walks over a large heap that are bound by TLB misses: the
+ * heap is filled with blocks of 200 to 1800 bytes, every other block is
+ * freed with coalescing deferred and coalesce() merges them, then the
+ * rest is freed and merged again. Each free block lies on a different
+ * page, so with normal pages nearly every step of the walk misses the TLB.
+ *
+ * Run it with and without -H to see what huge pages save.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "p3Heap.h"
+
+/*
+ * Gets the current time
+ *
+ * retval: nanoseconds since some fixed point
+ */
+long nanoTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * Gets how much of the process is backed by transparent huge pages
+ *
+ * retval: kilobytes, -1 if the kernel does not say
+ */
+long hugeKilobytes() {
+	FILE* smaps = fopen("/proc/self/smaps_rollup", "r");
+	char line[256];
+	long kb = -1;
+
+	if (smaps == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), smaps) != NULL) {
+		if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+			break;
+		}
+	}
+	fclose(smaps);
+	return kb;
+}
+
+/*
+ * Prints the usage message and exits
+ *
+ * argv: the command line arguments
+ * status: the exit status, 0 for -h and 1 for a usage error
+ */
+void printUsage(char* argv[], int status) {
+	printf("Usage: %s [-hH] [-s <size>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h         Print this help message.\n");
+	printf("  -H         Back the heap with huge pages.\n");
+	printf("  -s <size>  Heap size (default 1 GiB).\n");
+	printf("\nExamples:\n");
+	printf("  linux>  %s -H -s 2147483648\n", argv[0]);
+	exit(status);
+}
+
+int main(int argc, char* argv[]) {
+	size_t heap_size = 1UL << 30;
+	int c;
+
+	while ((c = getopt(argc, argv, "hHs:")) != -1) {
+		switch (c) {
+		case 'H':
+			set_huge_pages(1);
+			break;
+		case 's':
+			heap_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			printUsage(argv, 0);
+		default:
+			printUsage(argv, 1);
+		}
+	}
+
+	set_coalesce_mode(COALESCE_DEFERRED);
+	if (init_heap(heap_size) != 0) {
+		exit(1);
+	}
+	size_t max_blocks = heap_size / 200;
+	void** blocks = malloc(max_blocks * sizeof(void*));
+	if (blocks == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	srand(1);
+
+	long start = nanoTime();
+	size_t num_blocks = 0;
+	while (num_blocks < max_blocks &&
+	       (blocks[num_blocks] = balloc(200 + rand() % 1600)) != NULL) {
+		num_blocks++;
+	}
+	long filled = nanoTime();
+	for (size_t i = 0; i < num_blocks; i += 2) {
+		bfree(blocks[i]);
+	}
+	long freed = nanoTime();
+	coalesce();
+	long merged = nanoTime();
+	for (size_t i = 1; i < num_blocks; i += 2) {
+		bfree(blocks[i]);
+	}
+	long freed_rest = nanoTime();
+	coalesce();
+	long merged_rest = nanoTime();
+
+	printf("blocks       %zu\n", num_blocks);
+	printf("fill         %.0f ms\n", (filled - start) / 1e6);
+	printf("free half    %.0f ms, coalesce %.0f ms\n",
+	       (freed - filled) / 1e6, (merged - freed) / 1e6);
+	printf("free rest    %.0f ms, coalesce %.0f ms\n",
+	       (freed_rest - merged) / 1e6, (merged_rest - freed_rest) / 1e6);
+	long huge_kb = hugeKilobytes();
+	if (huge_kb >= 0) {
+		printf("huge pages   %ld MiB\n", huge_kb / 1024);
+	}
+
+	free(blocks);
+	return 0;
+}
@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that p3Heap.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * cap2trace.c:
+ * Turns a capture log written by start_capture() into a trace that bheap
+ * can replay (see gentrace.c for the format), so a recorded run can be
+ * tried against other heap settings.
+ *
+ * Each block that was allocated gets its own id, found again on later
+ * calls through its offset. Failed calls and coalesce() calls are left
+ * out, and balloc_aligned() calls become plain allocations. The log is
+ * only in time order per thread, so records are sorted by time first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+/*
+ * Open addressing table from the offset of each live block to its id
+ */
+typedef struct liveTable {
+	uint64_t* offsets;
+	int* ids;
+	size_t capacity;    // a power of two
+	size_t count;
+} liveTable;
+
+#define EMPTY CAPTURE_NULL
+
+/*
+ * Gets the slot holding an offset, or the empty slot where it would go
+ */
+size_t findSlot(liveTable* table, uint64_t offset) {
+	size_t slot = (offset * 0x9E3779B97F4A7C15ULL) & (table->capacity - 1);
+	while (table->offsets[slot] != EMPTY && table->offsets[slot] != offset) {
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	return slot;
+}
+
+/*
+ * Makes the table the given size and puts every entry back in
+ */
+void resizeTable(liveTable* table, size_t capacity) {
+	uint64_t* old_offsets = table->offsets;
+	int* old_ids = table->ids;
+	size_t old_capacity = table->capacity;
+
+	table->offsets = malloc(capacity * sizeof(uint64_t));
+	table->ids = malloc(capacity * sizeof(int));
+	if (table->offsets == NULL || table->ids == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	memset(table->offsets, 0xff, capacity * sizeof(uint64_t));
+	table->capacity = capacity;
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old_offsets[i] != EMPTY) {
+			size_t slot = findSlot(table, old_offsets[i]);
+			table->offsets[slot] = old_offsets[i];
+			table->ids[slot] = old_ids[i];
+		}
+	}
+	free(old_offsets);
+	free(old_ids);
+}
+
+/*
+ * Records the id of a newly allocated block
+ */
+void addLive(liveTable* table, uint64_t offset, int id) {
+	if (2 * (table->count + 1) > table->capacity) {
+		resizeTable(table, 2 * table->capacity);
+	}
+	size_t slot = findSlot(table, offset);
+	if (table->offsets[slot] == EMPTY) {
+		table->count++;
+	}
+	table->offsets[slot] = offset;
+	table->ids[slot] = id;
+}
+
+/*
+ * Forgets a block that was freed or moved
+ *
+ * retval: the block's id, -1 if no live block has this offset
+ */
+int removeLive(liveTable* table, uint64_t offset) {
+	size_t slot = findSlot(table, offset);
+	if (table->offsets[slot] == EMPTY) {
+		return -1;
+	}
+	int id = table->ids[slot];
+	table->offsets[slot] = EMPTY;
+	table->count--;
+
+	//Move later entries of the same run up so lookups do not stop early
+	size_t next = (slot + 1) & (table->capacity - 1);
+	while (table->offsets[next] != EMPTY) {
+		uint64_t moved = table->offsets[next];
+		int moved_id = table->ids[next];
+		table->offsets[next] = EMPTY;
+		size_t to = findSlot(table, moved);
+		table->offsets[to] = moved;
+		table->ids[to] = moved_id;
+		next = (next + 1) & (table->capacity - 1);
+	}
+	return id;
+}
+
+/*
+ * A record and where it was in the log, which breaks ties between records
+ * of the same time
+ */
+typedef struct loggedRecord {
+	captureRecord record;
+	size_t index;
+} loggedRecord;
+
+int compareRecords(const void* a, const void* b) {
+	const loggedRecord* first = a;
+	const loggedRecord* second = b;
+	uint64_t first_time = CAPTURE_TIME(first->record);
+	uint64_t second_time = CAPTURE_TIME(second->record);
+	if (first_time != second_time) {
+		return first_time < second_time ? -1 : 1;
+	}
+	return first->index < second->index ? -1 : first->index > second->index;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		printf("Usage: %s <capture log> > <trace>\n", argv[0]);
+		exit(1);
+	}
+	FILE* log = fopen(argv[1], "rb");
+	char magic[sizeof(CAPTURE_MAGIC)];
+	if (log == NULL || fread(magic, sizeof(magic), 1, log) != 1 ||
+	    memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		fprintf(stderr, "Error: %s is not a capture log\n", argv[1]);
+		exit(1);
+	}
+
+	size_t num_records = 0, max_records = 1024;
+	loggedRecord* records = malloc(max_records * sizeof(loggedRecord));
+	while (records != NULL &&
+	       fread(&records[num_records].record, sizeof(captureRecord), 1, log) == 1) {
+		records[num_records].index = num_records;
+		if (++num_records == max_records) {
+			max_records *= 2;
+			records = realloc(records, max_records * sizeof(loggedRecord));
+		}
+	}
+	fclose(log);
+	if (records == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	qsort(records, num_records, sizeof(loggedRecord), compareRecords);
+
+	liveTable table = {NULL, NULL, 0, 0};
+	resizeTable(&table, 1024);
+
+	//Ops are kept until the header, which counts them, is written
+	size_t num_ops = 0, max_ops = 1024;
+	char* types = malloc(max_ops);
+	int* ids = malloc(max_ops * sizeof(int));
+	uint64_t* sizes = malloc(max_ops * sizeof(uint64_t));
+	int next_id = 0;
+	int unmatched = 0;
+	uint64_t curr_bytes = 0, peak_bytes = 0;
+	uint64_t* live_size = malloc(1024 * sizeof(uint64_t));
+	size_t max_ids = 1024;
+
+	for (size_t i = 0; i < num_records; i++) {
+		captureRecord record = records[i].record;
+		int op = CAPTURE_OP(record);
+		int id;
+
+		if (num_ops == max_ops) {
+			max_ops *= 2;
+			types = realloc(types, max_ops);
+			ids = realloc(ids, max_ops * sizeof(int));
+			sizes = realloc(sizes, max_ops * sizeof(uint64_t));
+		}
+		if (next_id == max_ids) {
+			max_ids *= 2;
+			live_size = realloc(live_size, max_ids * sizeof(uint64_t));
+		}
+		if (types == NULL || ids == NULL || sizes == NULL || live_size == NULL) {
+			fprintf(stderr, "Error: out of memory\n");
+			exit(1);
+		}
+
+		switch (op) {
+		case CAPTURE_BALLOC:
+		case CAPTURE_ALIGNED:
+			if (record.offset == CAPTURE_NULL) {
+				continue;
+			}
+			id = next_id++;
+			addLive(&table, record.offset, id);
+			types[num_ops] = 'a';
+			live_size[id] = record.size;
+			curr_bytes += record.size;
+			break;
+		case CAPTURE_BREALLOC:
+			if (record.offset == CAPTURE_NULL) {
+				continue;
+			}
+			id = removeLive(&table, record.extra);
+			if (id < 0) {
+				unmatched++;
+				continue;
+			}
+			addLive(&table, record.offset, id);
+			types[num_ops] = 'r';
+			curr_bytes += record.size - live_size[id];
+			live_size[id] = record.size;
+			break;
+		case CAPTURE_BFREE:
+			id = removeLive(&table, record.offset);
+			if (id < 0) {
+				unmatched++;
+				continue;
+			}
+			types[num_ops] = 'f';
+			curr_bytes -= live_size[id];
+			break;
+		default:
+			continue;
+		}
+		ids[num_ops] = id;
+		sizes[num_ops++] = record.size;
+		if (curr_bytes > peak_bytes) {
+			peak_bytes = curr_bytes;
+		}
+	}
+	if (unmatched > 0) {
+		fprintf(stderr, "Warning: %d calls on blocks the log never allocated\n", unmatched);
+	}
+
+	//Suggest a heap twice the peak payload, as gentrace does
+	printf("%llu\n%d\n%zu\n1\n", (unsigned long long)(2 * peak_bytes), next_id, num_ops);
+	for (size_t i = 0; i < num_ops; i++) {
+		if (types[i] == 'f') {
+			printf("f %d\n", ids[i]);
+		} else {
+			printf("%c %d %llu\n", types[i], ids[i], (unsigned long long)sizes[i]);
+		}
+	}
+
+	free(records);
+	free(types);
+	free(ids);
+	free(sizes);
+	free(live_size);
+	free(table.offsets);
+	free(table.ids);
+	return 0;
+}
@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that p3Heap.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * gentrace.c:
+ * Writes a synthetic allocation trace for bheap to stdout, in the format of
+ * the classic malloc-lab traces:
+ *
+ *   <suggested heap size>
+ *   <number of ids>
+ *   <number of ops>
+ *   <weight>
+ *   a <id> <size>     allocate size bytes for id
+ *   r <id> <size>     resize the block of id to size bytes
+ *   f <id>            free the block of id
+ *
+ * Every id is allocated once, and all blocks are freed by the end.
+ *
+ * Size distributions:
+ *   uniform   sizes spread evenly from 1 to the maximum size
+ *   powerlaw  mostly small sizes with a long tail up to the maximum size
+ *   phase     the program switches between phases of small and large
+ *             blocks, freeing most of the old phase's blocks as it goes
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PHASES 8        // phase changes in a phase trace
+#define REALLOC_PCT 10  // percent of ops on live blocks that resize them
+
+typedef enum { UNIFORM, POWERLAW, PHASE } distribution;
+
+typedef struct op {
+	char type;
+	int id;
+	int size;
+} op;
+
+/*
+ * Picks a size from the distribution
+ *
+ * dist: the size distribution
+ * max_size: the largest size to pick
+ * phase: the current phase of a phase trace
+ *
+ * retval: a size from 1 to max_size
+ */
+int pickSize(distribution dist, int max_size, int phase) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	switch (dist) {
+	case UNIFORM:
+		return 1 + (int)(u * max_size);
+	case POWERLAW: {
+		//Pareto with alpha 1.2 and a minimum of 8 bytes
+		double size = 8 * pow(u, -1 / 1.2);
+		return size > max_size ? max_size : (int)size;
+	}
+	case PHASE:
+	default:
+		//Even phases allocate small objects, odd ones large buffers
+		if (phase % 2 == 0) {
+			return 16 + (int)(u * 48);
+		}
+		return max_size / 8 + (int)(u * (max_size - max_size / 8));
+	}
+}
+
+/*
+ * Prints the usage message and exits
+ *
+ * argv: the command line arguments
+ * status: the exit status, 0 for -h and 1 for a usage error
+ */
+void printUsage(char* argv[], int status) {
+	printf("Usage: %s [-h] -d <dist> [-n <ops>] [-l <live>] [-m <max>] [-s <seed>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h         Print this help message.\n");
+	printf("  -d <dist>  Size distribution: uniform, powerlaw or phase.\n");
+	printf("  -n <ops>   Number of alloc and realloc ops (default 100000).\n");
+	printf("  -l <live>  Average number of live blocks (default 1000).\n");
+	printf("  -m <max>   Largest block size (default 4096).\n");
+	printf("  -s <seed>  Seed for the random numbers (default 1).\n");
+	printf("\nExamples:\n");
+	printf("  linux>  %s -d powerlaw -n 50000 > traces/powerlaw.rep\n", argv[0]);
+	exit(status);
+}
+
+int main(int argc, char* argv[]) {
+	distribution dist = UNIFORM;
+	int dist_set = 0;
+	int num_allocs = 100000;
+	int live_target = 1000;
+	int max_size = 4096;
+	int seed = 1;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:n:l:m:s:h")) != -1) {
+		switch (c) {
+		case 'd':
+			dist_set = 1;
+			if (strcmp(optarg, "uniform") == 0) {
+				dist = UNIFORM;
+			} else if (strcmp(optarg, "powerlaw") == 0) {
+				dist = POWERLAW;
+			} else if (strcmp(optarg, "phase") == 0) {
+				dist = PHASE;
+			} else {
+				printUsage(argv, 1);
+			}
+			break;
+		case 'n':
+			num_allocs = atoi(optarg);
+			break;
+		case 'l':
+			live_target = atoi(optarg);
+			break;
+		case 'm':
+			max_size = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'h':
+			printUsage(argv, 0);
+		default:
+			printUsage(argv, 1);
+		}
+	}
+	if (!dist_set || num_allocs <= 0 || live_target <= 0 || max_size <= 0) {
+		printUsage(argv, 1);
+	}
+	srand(seed);
+
+	//Every alloc is freed once, so there are at most three ops per alloc
+	op* ops = malloc(3 * num_allocs * sizeof(op));
+	int* live = malloc(num_allocs * sizeof(int));
+	int* live_size = malloc(num_allocs * sizeof(int));
+	if (ops == NULL || live == NULL || live_size == NULL) {
+		fprintf(stderr, "Error: out of memory\n");
+		exit(1);
+	}
+	int num_ops = 0;
+	int num_live = 0;
+	int next_id = 0;
+	long curr_bytes = 0;
+	long peak_bytes = 0;
+
+	for (int i = 0; i < num_allocs; i++) {
+		int phase = i / (num_allocs / PHASES + 1);
+
+		//A new phase frees most of the blocks of the last one
+		if (dist == PHASE && i > 0 && phase != (i - 1) / (num_allocs / PHASES + 1)) {
+			for (int j = num_live - 1; j >= 0; j--) {
+				if (rand() % 10 != 0) {
+					ops[num_ops++] = (op){'f', live[j], 0};
+					curr_bytes -= live_size[j];
+					live[j] = live[--num_live];
+					live_size[j] = live_size[num_live];
+				}
+			}
+		}
+
+		//Keep the number of live blocks around the target
+		while (num_live > 0 && rand() % (2 * live_target) < num_live) {
+			int j = rand() % num_live;
+			ops[num_ops++] = (op){'f', live[j], 0};
+			curr_bytes -= live_size[j];
+			live[j] = live[--num_live];
+			live_size[j] = live_size[num_live];
+		}
+
+		int size = pickSize(dist, max_size, phase);
+		if (num_live > 0 && rand() % 100 < REALLOC_PCT) {
+			int j = rand() % num_live;
+			ops[num_ops++] = (op){'r', live[j], size};
+			curr_bytes += size - live_size[j];
+			live_size[j] = size;
+		} else {
+			ops[num_ops++] = (op){'a', next_id, size};
+			live[num_live] = next_id++;
+			live_size[num_live++] = size;
+			curr_bytes += size;
+		}
+		if (curr_bytes > peak_bytes) {
+			peak_bytes = curr_bytes;
+		}
+	}
+	while (num_live > 0) {
+		ops[num_ops++] = (op){'f', live[--num_live], 0};
+	}
+
+	//Suggest a heap twice the peak payload
+	printf("%ld\n%d\n%d\n1\n", 2 * peak_bytes, next_id, num_ops);
+	for (int i = 0; i < num_ops; i++) {
+		if (ops[i].type == 'f') {
+			printf("f %d\n", ops[i].id);
+		} else {
+			printf("%c %d %d\n", ops[i].type, ops[i].id, ops[i].size);
+		}
+	}
+
+	free(ops);
+	free(live);
+	free(live_size);
+	return 0;
+}
@@ -6,13 +6,19 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "p3Heap.h"
  
 /*
@@ -21,10 +27,11 @@
  */
 typedef struct blockHeader {           
 
-    int size_status;
+    size_t size_status;
 
     /*
-     * Size of the block is always a multiple of 8.
+     * Size of the block is always a multiple of 16 (ALIGNMENT), so every
+     * payload is 16-byte aligned.
      * Size is stored in all block headers and in free block footers.
      *
      * Status is stored only in headers using the two least significant bits.
@@ -35,317 +42,3559 @@ typedef struct blockHeader {
      *   Bit1 => second last bit 
      *   Bit1 == 0 => previous block is free
      *   Bit1 == 1 => previous block is allocated
+     *
+     *   Bit2 => third last bit, only set in allocated block headers
+     *   Bit2 == 1 => the block has its own mapping outside the heap
+     *                (see mmapBlock())
      * 
      * Start Heap: 
-     *  The blockHeader for the first block of the heap is after skip 4 bytes.
-     *  This ensures alignment requirements can be met.
+     *  The blockHeader for the first block of each heap region follows the
+     *  region's heapRegion and enough padding to meet alignment requirements.
      * 
      * End Mark: 
-     *  The end of the available memory is indicated using a size_status of 1.
+     *  The end of the available memory is indicated using a header of size 0
+     *  with the a-bit set, i.e. a size_status of 1 (or 3 once the p-bit is set
+     *  because the last block of the heap is allocated).
      * 
      * Examples:
      * 
-     * 1. Allocated block of size 24 bytes:
+     * 1. Allocated block of size 48 bytes:
      *    Allocated Block Header:
-     *      If the previous block is free      p-bit=0 size_status would be 25
-     *      If the previous block is allocated p-bit=1 size_status would be 27
+     *      If the previous block is free      p-bit=0 size_status would be 49
+     *      If the previous block is allocated p-bit=1 size_status would be 51
      * 
-     * 2. Free block of size 24 bytes:
+     * 2. Free block of size 48 bytes:
      *    Free Block Header:
-     *      If the previous block is free      p-bit=0 size_status would be 24
-     *      If the previous block is allocated p-bit=1 size_status would be 26
+     *      If the previous block is free      p-bit=0 size_status would be 48
+     *      If the previous block is allocated p-bit=1 size_status would be 50
      *    Free Block Footer:
-     *      size_status should be 24
+     *      size_status should be 48
      */
 } blockHeader;         
 
+/* Payload alignment and the granularity of all block sizes.
+ * 16 bytes is enough for any SSE/AVX load of a whole vector.
+ */
+#define ALIGNMENT 16
+
 /* Global variable - DO NOT CHANGE NAME or TYPE. 
  * It must point to the first block in the heap and is set by init_heap()
  * i.e., the block at the lowest address.
  */
 blockHeader *heap_start = NULL;     
 
-/* Size of heap allocation padded to round to nearest page size.
+/*
+ * Additional global variables may be added as needed below
+ * TODO: add global variables needed by your function
+ */
+
+/*
+ * Free blocks are kept in segregated size-class bins so that balloc() only
+ * looks at blocks that can possibly fit.
+ *
+ * Bins 0 .. NUM_SMALL_BINS-1 are exact bins: bin i holds free blocks of
+ * exactly i * ALIGNMENT bytes (bins 0 and 1 are never used).
+ * The remaining bins hold power-of-two ranges: the first large bin holds
+ * sizes [SMALL_BIN_LIMIT, 2 * SMALL_BIN_LIMIT), the next one the doubling
+ * of that range and so on.
+ *
+ * Each bin is a doubly-linked list threaded through the free blocks
+ * themselves. A free block stores the link to the next free block of its bin
+ * in the first word of its payload and the link to the previous one in the
+ * second word, so a free block needs room for a header, both links and a
+ * footer:
+ *
+ *   | header | next | prev | ... | footer |
+ */
+#define NUM_SMALL_BINS  64
+#define SMALL_BIN_LIMIT (NUM_SMALL_BINS * ALIGNMENT)
+#define SMALL_BIN_SHIFT 10
+#define NUM_LARGE_BINS  (sizeof(size_t) * 8 - SMALL_BIN_SHIFT)
+#define NUM_BINS        (NUM_SMALL_BINS + NUM_LARGE_BINS)
+#define BIN_MAP_WORDS   ((NUM_BINS + 31) / 32)
+
+#define MIN_BLOCK_SIZE  \
+	((2 * sizeof(blockHeader) + 2 * sizeof(blockHeader*) + ALIGNMENT - 1) & \
+	 ~(size_t)(ALIGNMENT - 1))
+
+#ifdef BEST_FIT_TREE
+/*
+ * When built with BEST_FIT_TREE, free blocks too large for the exact bins
+ * are kept in a red-black tree ordered by size and then address instead of
+ * the power-of-two bins, so balloc() finds the exact best fit for them in
+ * O(log n). The tree node lives in the payload after the list links:
+ *
+ *   | header | next | prev | left | right | parent | color | ... | footer |
+ *
+ * Every block in the tree is at least SMALL_BIN_LIMIT bytes, so there is
+ * always room for the node.
+ */
+#define RED   0
+#define BLACK 1
+
+typedef struct treeNode {
+	blockHeader *left;
+	blockHeader *right;
+	blockHeader *parent;
+	int color;
+} treeNode;
+#endif
+
+/*
+ * Free blocks of at least SMALL_BIN_LIMIT bytes also hold a purge stamp
+ * after the list links and, with BEST_FIT_TREE, the tree node:
+ *
+ *   | header | next | prev | (tree node) | stamp | ... | footer |
+ *
+ * A block is stamped PURGE_DIRTY whenever it is binned. The first purge
+ * pass to see it replaces that with the time, and a later pass gives its
+ * pages back once the block has been free for the purge decay, leaving a
+ * stamp of PURGE_CLEAN. Only whole pages past the stamp and before the
+ * footer are given back, so the block keeps all of its bookkeeping.
+ */
+#ifdef BEST_FIT_TREE
+#define PURGE_STAMP_OFFSET \
+	(sizeof(blockHeader) + 2 * sizeof(blockHeader*) + sizeof(treeNode))
+#else
+#define PURGE_STAMP_OFFSET (sizeof(blockHeader) + 2 * sizeof(blockHeader*))
+#endif
+#define PURGE_CLEAN 0
+#define PURGE_DIRTY 1
+
+/*
+ * The heap is made of one or more regions, each a separate mapping.
+ * init_heap() maps the first one; when growth is enabled balloc() adds
+ * space by extending the last region in place with mremap() or, when that
+ * is not possible, by mapping another region.
+ *
+ * Every region starts with a heapRegion linking it to the next region,
+ * is padded so that payloads stay ALIGNMENT aligned, and ends with its
+ * own end mark:
+ *
+ *   | heapRegion | pad | first block | ... | last block | end mark |
+ */
+typedef struct heapRegion {
+	struct heapRegion *next;
+	size_t size;            // bytes mapped for this region
+} heapRegion;
+
+/* Offset of the first block header from the start of its region.
+ */
+#define REGION_OFFSET \
+	(((sizeof(heapRegion) + sizeof(blockHeader) + ALIGNMENT - 1) & \
+	  ~(size_t)(ALIGNMENT - 1)) - sizeof(blockHeader))
+
+/* Size and alignment of a huge page, see set_huge_pages().
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Bit2 of size_status, marks a block with its own mapping.
+ */
+#define MMAP_BIT 4
+
+/*
+ * Blocks with their own mapping are listed by the heap they belong to, so
+ * heap_destroy() can unmap them. The links sit in front of the header,
+ * with a mark that lets bfree() recognize the block without the lock:
+ *
+ *   | next | prev | owner | mark | header | payload ... |
+ */
+#define MAPPED_MAGIC ((uintptr_t)0x3a99ed3a99ed3a99ULL)
+
+typedef struct mappedBlock {
+	struct mappedBlock *next;
+	struct mappedBlock *prev;
+	struct heap *owner;
+	uintptr_t mark;         // address of the mapping ^ MAPPED_MAGIC
+} mappedBlock;
+
+/* Offset of the payload from the start of its mapping.
+ */
+#define MAPPED_OFFSET \
+	((sizeof(mappedBlock) + sizeof(blockHeader) + ALIGNMENT - 1) & \
+	 ~(size_t)(ALIGNMENT - 1))
+
+/*
+ * A mark/release arena is one allocated block that arena_alloc() carves
+ * up from the front. The arena's own state sits in its first block, every
+ * block handed out gets a real header, and the rest of the arena is kept
+ * as one more allocated block, so the heap stays walkable:
+ *
+ *   | header | markArena | header | block | ... | header | rest ... |
+ *
+ * Releasing to a mark turns everything from the mark on back into the
+ * rest, and closing the arena frees it all as one block.
+ */
+struct markArena {
+	blockHeader *rest;      // header of the part not handed out yet
+	void *end;              // first byte after the arena
+	heap *owner;
+};
+
+/*
+ * With slabs turned on, requests of at most SLAB_MAX_SIZE bytes come from
+ * slabs rather than blocks. A slab is a heap block whose payload is a
+ * SLAB_SIZE aligned page holding the slab's state followed by slots of one
+ * size class. Slots have no header of their own:
+ *
+ *   | header | slab | slot | slot | ... | slot |
+ *
+ * Masking the low bits of a slot address gives its slab, and the slab's
+ * mark together with SLAB_BIT in the block header tells a slab apart from
+ * any other block. That check is O(1), but findSlab() first looks for the
+ * region holding the address, which takes a step per region. A set bit in
+ * free_map marks a free slot. Slabs with free slots are listed per size
+ * class.
+ */
+#define SLAB_SIZE        4096
+#define SLAB_MAX_SIZE    256
+#define NUM_SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+#define SLAB_MAGIC       ((uintptr_t)0x51ab51ab51ab51abULL)
+
+/* Bit3 of size_status, marks the block that holds a slab.
+ */
+#define SLAB_BIT 8
+
+typedef struct slab {
+	struct slab *next;      // in the list of slabs of its class with
+	struct slab *prev;      // free slots
+	uintptr_t mark;         // address of the slab ^ SLAB_MAGIC
+	unsigned int size;      // slot size
+	unsigned int slots;     // number of slots
+	unsigned int used;      // slots handed out
+	uint64_t free_map[(SLAB_SIZE / ALIGNMENT + 63) / 64];
+} slab;
+
+/* Offset of the first slot from the start of its slab.
+ */
+#define SLOTS_OFFSET \
+	((sizeof(slab) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+/*
+ * In thread-safe mode every change to a heap happens under its lock.
+ * To keep the lock off the common path each thread keeps a small cache of
+ * blocks per exact size class. A cached block stays allocated as far as the
+ * heap is concerned; its payload holds the link to the next cached block and
+ * CACHE_MARK, which lets bfree() catch most double frees:
+ *
+ *   | header | next cached | CACHE_MARK | ... |
+ *
+ * An empty cache is refilled with CACHE_BATCH blocks under one lock
+ * acquisition and a full one hands CACHE_BATCH blocks back the same way.
+ *
+ * Freeing never waits for the lock. If another thread holds it the blocks
+ * are pushed onto remote_frees, a lock-free stack linked through the same
+ * payload word, and whoever takes the lock next frees them. A block that
+ * bfree() pushes is marked with REMOTE_MARK in the word after the link
+ * until it is freed, so freeing it again fails.
+ *
+ * Only the default heap has thread caches, other heaps always lock.
+ */
+#define CACHE_LIMIT 32
+#define CACHE_BATCH 16
+#define CACHE_MARK  ((void*)&default_heap.lock)
+#define REMOTE_MARK ((void*)&default_heap.remote_frees)
+
+typedef struct threadCache {
+	blockHeader *heads[NUM_SMALL_BINS];
+	int counts[NUM_SMALL_BINS];
+	int registered;         // set once the exit handler knows the cache
+} threadCache;
+
+__thread threadCache thread_cache;
+
+/* Flushes a thread's cache when the thread exits.
+ */
+pthread_key_t cache_key;
+pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+/*
+ * While capturing, every call is recorded in the calling thread's
+ * capture_batch, so a call touches nothing that other threads write. A
+ * full batch is handed on to capture_ring: the thread takes the next
+ * position from capture_head, copies the batch into that slot and marks
+ * it ready by storing its position + 1 in seq. A flusher thread writes
+ * ready batches to capture_fd in order and moves capture_tail past them,
+ * which frees their slots. Threads only wait when the ring is full.
+ * stop_capture() hands on the batches that are not full yet, found
+ * through capture_batches, and so does a thread that exits.
+ *
+ * Callers stamp records with the cheapest clock there is, the time stamp
+ * counter on x86-64, and the flusher turns ticks into nanoseconds at one
+ * rate for the whole capture. Batches of different threads are written
+ * in the order they fill up, so the log is in time order per thread and
+ * cap2trace sorts it by time.
+ */
+#define CAPTURE_BATCH 128       // records a thread gathers at once
+#define CAPTURE_RING  512       // batches, a power of two
+#define CAPTURE_WRITE 64        // batches the flusher writes at once
+#define CAPTURE_WAIT  10        // milliseconds between flushes
+
+#if defined(__x86_64__)
+#define captureTicks() __builtin_ia32_rdtsc()
+#else
+#define captureTicks() ((uint64_t)heapClock())
+#endif
+
+typedef struct captureBatch {
+	captureRecord records[CAPTURE_BATCH];
+	int count;
+	int registered;              // a thread's batch, listed in
+	struct captureBatch *next;   // capture_batches
+	uint64_t seq;                // a ring slot's position + 1 once ready
+} captureBatch;
+
+int capture_on = 0;
+int capture_fd = -1;
+long capture_start;          // heapClock() when the capture started
+uint64_t capture_start_ticks; // captureTicks() at the same time
+double capture_rate;         // ticks per nanosecond, 0 until measured
+captureBatch capture_ring[CAPTURE_RING];
+uint64_t capture_head = 0;
+uint64_t capture_tail = 0;
+pthread_t capture_thread;
+pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t capture_wake = PTHREAD_COND_INITIALIZER;
+
+__thread captureBatch capture_batch;
+captureBatch *capture_batches = NULL;
+pthread_mutex_t capture_batches_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t capture_key;
+pthread_once_t capture_key_once = PTHREAD_ONCE_INIT;
+
+#ifdef TRACE_METADATA
+/*
+ * While tracing, every read and write of block headers, footers, free list
+ * links, tree nodes and bin heads is written to trace_fd as a line in the
+ * format of Valgrind's lackey tool, " L <address>,<length>" for a read and
+ * " S <address>,<length>" for a write, which p4B/csim replays. Lines are
+ * gathered in trace_buffer and written out whenever it fills up, without
+ * stdio, so tracing works under libheapmalloc.so too.
+ *
+ * Only builds with TRACE_METADATA can trace, so other builds pay nothing
+ * for it.
+ */
+#define TRACE_BUFFER 65536
+
+int trace_fd = -1;
+char trace_buffer[TRACE_BUFFER];
+size_t trace_used = 0;
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Writes out the lines gathered in trace_buffer. Called with trace_lock
+ * held.
+ *
+ * retval: 0 on success, -1 if the file could not take them all
+ */
+int flushTrace(){
+	size_t written = 0;
+	while (written < trace_used){
+		ssize_t bytes = write(trace_fd, trace_buffer + written, trace_used - written);
+		if (bytes <= 0){
+			return -1;
+		}
+		written += bytes;
+	}
+	trace_used = 0;
+	return 0;
+}
+
+/*
+ * Appends one access to the trace
+ *
+ * type: 'L' for a read, 'S' for a write
+ * addr: the first byte accessed
+ * len: number of bytes accessed
+ */
+void traceAccess(char type, void* addr, size_t len){
+	pthread_mutex_lock(&trace_lock);
+
+	//Stop rather than leave a hole in the trace
+	if (trace_fd >= 0 && trace_used + 64 > TRACE_BUFFER && flushTrace() != 0){
+		close(trace_fd);
+		trace_fd = -1;
+	}
+	if (trace_fd >= 0){
+		trace_used += snprintf(trace_buffer + trace_used, 64, " %c %lx,%zu\n",
+				       type, (unsigned long)addr, len);
+	}
+	pthread_mutex_unlock(&trace_lock);
+}
+
+#define traceLoad(addr, len) \
+	do { if (trace_fd >= 0) traceAccess('L', (void*)(addr), (len)); } while (0)
+#define traceStore(addr, len) \
+	do { if (trace_fd >= 0) traceAccess('S', (void*)(addr), (len)); } while (0)
+#else
+#define traceLoad(addr, len)
+#define traceStore(addr, len)
+#endif
+
+/*
+ * Everything that makes up one heap. init_heap() sets up default_heap,
+ * which the functions without a heap argument use; heap_create() makes
+ * more heaps, each in a mapping of its own.
+ */
+struct heap {
+	blockHeader *bins[NUM_BINS];          // head of the free list for each bin
+	unsigned int bin_map[BIN_MAP_WORDS];  // bit set while its bin is not empty
+	size_t bin_max[NUM_LARGE_BINS];       // largest block in each large bin
+	size_t bin_max_count[NUM_LARGE_BINS]; // and how many blocks have that size
+#ifdef BEST_FIT_TREE
+	blockHeader *tree_root;               // tree of large free blocks
+#endif
+	heapRegion *regions;                  // in the order they were mapped
+	heapRegion *last_region;
+	size_t alloc_size;                    // usable size of all regions
+	mappedBlock *mapped;                  // blocks with their own mapping
+	size_t mapped_size;                   // bytes mapped for those blocks
+	blockHeader *rovers[NUM_BINS];        // where next fit resumes per bin
+	slab *slabs[NUM_SLAB_CLASSES];        // slabs with free slots per class
+	int slabs_made;                       // set once there is a slab
+
+	int heap_growth;         // balloc() may grow the heap instead of failing
+	size_t mmap_threshold;   // requests this large get their own mapping,
+	                         // 0 disables this
+	int coalesce_mode;       // COALESCE_IMMEDIATE: bfree() merges the block
+	                         // with its free neighbors. COALESCE_DEFERRED:
+	                         // bfree() only marks the block free, merging
+	                         // is left to coalesce().
+	int placement;           // PLACE_BEST_FIT, PLACE_FIRST_FIT,
+	                         // PLACE_NEXT_FIT or PLACE_GOOD_FIT
+	size_t purge_threshold;  // free blocks this large give their pages back,
+	                         // 0 disables this
+	int huge_pages;          // regions are backed by huge pages if possible
+	int use_slabs;           // small requests come from slabs
+	long purge_decay;        // nanoseconds a block stays free before that
+	long last_purge;         // heapClock() at the last purge pass
+	size_t purged_size;      // bytes given back to the kernel so far
+
+	//Counters for heap_stats(), kept up to date as blocks enter and leave
+	//the bins and as balloc() searches them
+	size_t free_size;
+	size_t free_blocks;
+	size_t class_blocks[STATS_CLASSES];
+	uint64_t searches[STATS_SEARCHES];
+
+	int thread_safe;         // every change happens under lock
+	pthread_mutex_t lock;
+	blockHeader *remote_frees;
+};
+
+heap default_heap = {
+	.coalesce_mode = COALESCE_IMMEDIATE,
+	.placement = PLACE_BEST_FIT,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Given a block header pointer returns the size of the 
+ * memory block.
+ *
+ * header: blockHeader pointer
+ *
+ * retval: size of the block
+ */
+size_t getSize(blockHeader* header){
+	traceLoad(header, sizeof(blockHeader));
+	return (header->size_status - (header->size_status % ALIGNMENT));
+}
+
+/*
+ * Given a block header return the p-bit for that header
+ *
+ * header: blockHeader pointer
+ *
+ * retval: the value of the p-bit
+ */
+int getPBit(blockHeader* header){
+	traceLoad(header, sizeof(blockHeader));
+	return (header->size_status >> 1) % 2;
+}
+
+/*
+ * Given a block header returns whether the block is free
+ *
+ * header: blockHeader pointer
+ *
+ * retval: 1 - if free
+ * 	   0 - otherwise
+ */
+int isFree(blockHeader* header){
+	traceLoad(header, sizeof(blockHeader));
+	return !(header->size_status & 1);	
+}
+
+/*
+ * Given a block header returns whether it is the end mark of the heap
+ *
+ * header: blockHeader pointer
+ *
+ * retval: 1 - if it is the end mark
+ * 	   0 - otherwise
+ */
+int isEndMark(blockHeader* header){
+	return getSize(header) == 0;
+}
+
+/*
+ * Get the pointer to the next block header
+ *
+ * header: current block header
+ *
+ * retval: the block header of the next block
+ */
+blockHeader* getNextHeader(blockHeader* header){
+	return (blockHeader*)((void*)header + getSize(header)); 
+}
+
+/*
+ * Creates a footer for a free block
+ * 
+ * free_block: the pointer to the header of the free block
+ */
+void createFooter(blockHeader* free_block){
+	size_t free_size = getSize(free_block);
+
+	//Initialize footer
+	blockHeader *footer = (blockHeader*)((void*)free_block + free_size - sizeof(blockHeader));
+	footer->size_status = free_size;
+	traceStore(footer, sizeof(blockHeader));
+	
+	blockHeader *next_header = getNextHeader(free_block);
+	if (getPBit(next_header)){
+		next_header->size_status -= 2;	
+		traceStore(next_header, sizeof(blockHeader));
+	}
+}
+
+/* 
+ * Creates a header to a memory location
+ *
+ * header_start: a blockHeader 
+ * size: the size of the block
+ * p_bit: the setting of the p-bit for the header
+ * a_bit: the setting of the a-bit for the header
+ */
+void createHeader(blockHeader* header_start, size_t size, int p_bit, int a_bit){
+	header_start->size_status = size + (2 * p_bit) + a_bit; 
+	traceStore(header_start, sizeof(blockHeader));
+	
+	//If this block is empty create a footer
+	if (a_bit == 0){
+		createFooter(header_start);
+	}
+
+	//Otherwise set the p-bit of the next header
+	else {
+		blockHeader* next_header = getNextHeader(header_start);
+		if (!(getPBit(next_header))){
+			next_header->size_status += 2;	
+			traceStore(next_header, sizeof(blockHeader));
+		}
+	}
+}
+
+/*
+ * Given a free block header returns the next free block in its bin
+ *
+ * free_block: header of a free block
+ *
+ * retval: the next free block in the bin, NULL at the end of the bin
+ */
+blockHeader* getNextFree(blockHeader* free_block){
+	traceLoad((void*)free_block + sizeof(blockHeader), sizeof(blockHeader*));
+	return *(blockHeader**)((void*)free_block + sizeof(blockHeader));
+}
+
+/*
+ * Sets the link to the next free block in a free block's payload
+ *
+ * free_block: header of a free block
+ * next: the free block that should follow it in its bin
+ */
+void setNextFree(blockHeader* free_block, blockHeader* next){
+	traceStore((void*)free_block + sizeof(blockHeader), sizeof(blockHeader*));
+	*(blockHeader**)((void*)free_block + sizeof(blockHeader)) = next;
+}
+
+/*
+ * Given a free block header returns the previous free block in its bin
+ *
+ * free_block: header of a free block
+ *
+ * retval: the previous free block in the bin, NULL at the head of the bin
+ */
+blockHeader* getPrevFree(blockHeader* free_block){
+	traceLoad((void*)free_block + sizeof(blockHeader) + sizeof(blockHeader*), 
+		  sizeof(blockHeader*));
+	return *(blockHeader**)((void*)free_block + sizeof(blockHeader) + 
+				sizeof(blockHeader*));
+}
+
+/*
+ * Sets the link to the previous free block in a free block's payload
+ *
+ * free_block: header of a free block
+ * prev: the free block that should precede it in its bin
+ */
+void setPrevFree(blockHeader* free_block, blockHeader* prev){
+	traceStore((void*)free_block + sizeof(blockHeader) + sizeof(blockHeader*), 
+		   sizeof(blockHeader*));
+	*(blockHeader**)((void*)free_block + sizeof(blockHeader) + 
+			 sizeof(blockHeader*)) = prev;
+}
+
+/*
+ * Gets the purge stamp of a free block of at least SMALL_BIN_LIMIT bytes
+ *
+ * free_block: header of the free block
+ *
+ * retval: PURGE_CLEAN, PURGE_DIRTY or the time a purge pass first saw it
  */
-int alloc_size;
+long getPurgeStamp(blockHeader* free_block){
+	traceLoad((void*)free_block + PURGE_STAMP_OFFSET, sizeof(long));
+	return *(long*)((void*)free_block + PURGE_STAMP_OFFSET);
+}
+
+/*
+ * Sets the purge stamp of a free block of at least SMALL_BIN_LIMIT bytes
+ *
+ * free_block: header of the free block
+ * stamp: PURGE_CLEAN, PURGE_DIRTY or a time from heapClock()
+ */
+void setPurgeStamp(blockHeader* free_block, long stamp){
+	traceStore((void*)free_block + PURGE_STAMP_OFFSET, sizeof(long));
+	*(long*)((void*)free_block + PURGE_STAMP_OFFSET) = stamp;
+}
+
+/*
+ * Given a block size returns the bin that holds free blocks of that size
+ *
+ * size: size of the block, a multiple of ALIGNMENT
+ *
+ * retval: index of the bin
+ */
+int getBinIndex(size_t size){
+	if (size < SMALL_BIN_LIMIT){
+		return size / ALIGNMENT;
+	}
+
+	//Power-of-two bins are indexed by the position of the highest set bit
+	int high_bit = sizeof(size_t) * 8 - 1 - __builtin_clzl(size);
+	return NUM_SMALL_BINS + high_bit - SMALL_BIN_SHIFT;
+}
+
+/*
+ * Finds the first bin at or after index that holds a free block
+ *
+ * h: the heap
+ * index: first bin to check
+ *
+ * retval: index of a non-empty bin, -1 if every remaining bin is empty
+ */
+int findNonEmptyBin(heap* h, int index){
+	int word = index / 32;
+	
+	if (index >= NUM_BINS){
+		return -1;
+	}
+
+	//Ignore the bins below index in the first word
+	traceLoad(&h->bin_map[word], sizeof(unsigned int));
+	unsigned int bits = h->bin_map[word] & (~0u << (index % 32));
+	while (bits == 0){
+		word++;
+		if (word == BIN_MAP_WORDS){
+			return -1;
+		}
+		traceLoad(&h->bin_map[word], sizeof(unsigned int));
+		bits = h->bin_map[word];
+	}
+	return word * 32 + __builtin_ctz(bits);
+}
+
+#ifdef BEST_FIT_TREE
+/*
+ * Given a free block in the tree returns its tree node
+ *
+ * free_block: header of a free block of at least SMALL_BIN_LIMIT bytes
+ *
+ * retval: the tree node stored in the block's payload
+ */
+treeNode* getNode(blockHeader* free_block){
+	//Traced as a read of the whole node, whichever fields are used
+	traceLoad((void*)free_block + sizeof(blockHeader) + 2 * sizeof(blockHeader*),
+		  sizeof(treeNode));
+	return (treeNode*)((void*)free_block + sizeof(blockHeader) + 
+			   2 * sizeof(blockHeader*));
+}
+
+/*
+ * Orders tree blocks by size and then by address
+ *
+ * retval: 1 - if block a goes before block b
+ * 	   0 - otherwise
+ */
+int treeLess(blockHeader* a, blockHeader* b){
+	if (getSize(a) != getSize(b)){
+		return getSize(a) < getSize(b);
+	}
+	return a < b;
+}
+
+/*
+ * Missing children are leaves, which count as black
+ */
+int isRed(blockHeader* node){
+	return node != NULL && getNode(node)->color == RED;
+}
+
+/*
+ * Replaces the subtree rooted at old_node with the one rooted at new_node
+ */
+void treeTransplant(heap* h, blockHeader* old_node, blockHeader* new_node){
+	blockHeader* parent = getNode(old_node)->parent;
+
+	if (parent == NULL){
+		h->tree_root = new_node;
+	}
+	else if (getNode(parent)->left == old_node){
+		getNode(parent)->left = new_node;
+	}
+	else {
+		getNode(parent)->right = new_node;
+	}
+	if (new_node != NULL){
+		getNode(new_node)->parent = parent;
+	}
+}
+
+/*
+ * Rotates node down to the left, its right child takes its place
+ */
+void rotateLeft(heap* h, blockHeader* node){
+	blockHeader* child = getNode(node)->right;
+
+	getNode(node)->right = getNode(child)->left;
+	if (getNode(child)->left != NULL){
+		getNode(getNode(child)->left)->parent = node;
+	}
+	treeTransplant(h, node, child);
+	getNode(child)->left = node;
+	getNode(node)->parent = child;
+}
+
+/*
+ * Rotates node down to the right, its left child takes its place
+ */
+void rotateRight(heap* h, blockHeader* node){
+	blockHeader* child = getNode(node)->left;
+
+	getNode(node)->left = getNode(child)->right;
+	if (getNode(child)->right != NULL){
+		getNode(getNode(child)->right)->parent = node;
+	}
+	treeTransplant(h, node, child);
+	getNode(child)->right = node;
+	getNode(node)->parent = child;
+}
+
+/*
+ * Returns the leftmost block of the subtree rooted at node
+ */
+blockHeader* treeMinimum(blockHeader* node){
+	while (getNode(node)->left != NULL){
+		node = getNode(node)->left;
+	}
+	return node;
+}
+
+/*
+ * Returns the block after node in tree order, NULL after the last one
+ */
+blockHeader* treeNext(blockHeader* node){
+	if (getNode(node)->right != NULL){
+		return treeMinimum(getNode(node)->right);
+	}
+	blockHeader* parent = getNode(node)->parent;
+	while (parent != NULL && node == getNode(parent)->right){
+		node = parent;
+		parent = getNode(parent)->parent;
+	}
+	return parent;
+}
+
+/*
+ * Adds a free block to the tree and restores the red-black properties
+ *
+ * h: the heap
+ * free_block: header of a free block of at least SMALL_BIN_LIMIT bytes
+ */
+void treeInsert(heap* h, blockHeader* free_block){
+	blockHeader* parent = NULL;
+	blockHeader* current = h->tree_root;
+
+	//Find the leaf position for the block
+	while (current != NULL){
+		parent = current;
+		if (treeLess(free_block, current)){
+			current = getNode(current)->left;
+		}
+		else {
+			current = getNode(current)->right;
+		}
+	}
+
+	treeNode* node = getNode(free_block);
+	node->left = NULL;
+	node->right = NULL;
+	node->parent = parent;
+	node->color = RED;
+	if (parent == NULL){
+		h->tree_root = free_block;
+	}
+	else if (treeLess(free_block, parent)){
+		getNode(parent)->left = free_block;
+	}
+	else {
+		getNode(parent)->right = free_block;
+	}
+
+	//Fix a red block with a red parent by recoloring or rotating
+	current = free_block;
+	while (isRed(getNode(current)->parent)){
+		parent = getNode(current)->parent;
+		blockHeader* grandparent = getNode(parent)->parent;
+
+		if (parent == getNode(grandparent)->left){
+			blockHeader* uncle = getNode(grandparent)->right;
+			if (isRed(uncle)){
+				getNode(parent)->color = BLACK;
+				getNode(uncle)->color = BLACK;
+				getNode(grandparent)->color = RED;
+				current = grandparent;
+				continue;
+			}
+			if (current == getNode(parent)->right){
+				rotateLeft(h, parent);
+				current = parent;
+				parent = getNode(current)->parent;
+			}
+			getNode(parent)->color = BLACK;
+			getNode(grandparent)->color = RED;
+			rotateRight(h, grandparent);
+		}
+		else {
+			blockHeader* uncle = getNode(grandparent)->left;
+			if (isRed(uncle)){
+				getNode(parent)->color = BLACK;
+				getNode(uncle)->color = BLACK;
+				getNode(grandparent)->color = RED;
+				current = grandparent;
+				continue;
+			}
+			if (current == getNode(parent)->left){
+				rotateRight(h, parent);
+				current = parent;
+				parent = getNode(current)->parent;
+			}
+			getNode(parent)->color = BLACK;
+			getNode(grandparent)->color = RED;
+			rotateLeft(h, grandparent);
+		}
+	}
+	getNode(h->tree_root)->color = BLACK;
+}
+
+/*
+ * Removes a free block from the tree and restores the red-black properties
+ *
+ * h: the heap
+ * free_block: header of a free block that is in the tree
+ */
+void treeRemove(heap* h, blockHeader* free_block){
+	treeNode* node = getNode(free_block);
+	blockHeader* child;
+	blockHeader* parent;
+	int removed_color = node->color;
+
+	//Unlink the block, or its successor when it has two children
+	if (node->left == NULL){
+		child = node->right;
+		parent = node->parent;
+		treeTransplant(h, free_block, child);
+	}
+	else if (node->right == NULL){
+		child = node->left;
+		parent = node->parent;
+		treeTransplant(h, free_block, child);
+	}
+	else {
+		blockHeader* successor = treeMinimum(node->right);
+		removed_color = getNode(successor)->color;
+		child = getNode(successor)->right;
+
+		if (getNode(successor)->parent == free_block){
+			parent = successor;
+		}
+		else {
+			parent = getNode(successor)->parent;
+			treeTransplant(h, successor, child);
+			getNode(successor)->right = node->right;
+			getNode(node->right)->parent = successor;
+		}
+		treeTransplant(h, free_block, successor);
+		getNode(successor)->left = node->left;
+		getNode(node->left)->parent = successor;
+		getNode(successor)->color = node->color;
+	}
+
+	if (removed_color == RED){
+		return;
+	}
+
+	//A black block was removed, so child carries an extra black
+	while (child != h->tree_root && !isRed(child)){
+		if (child == getNode(parent)->left){
+			blockHeader* sibling = getNode(parent)->right;
+			if (isRed(sibling)){
+				getNode(sibling)->color = BLACK;
+				getNode(parent)->color = RED;
+				rotateLeft(h, parent);
+				sibling = getNode(parent)->right;
+			}
+			if (!isRed(getNode(sibling)->left) && !isRed(getNode(sibling)->right)){
+				getNode(sibling)->color = RED;
+				child = parent;
+				parent = getNode(child)->parent;
+				continue;
+			}
+			if (!isRed(getNode(sibling)->right)){
+				getNode(getNode(sibling)->left)->color = BLACK;
+				getNode(sibling)->color = RED;
+				rotateRight(h, sibling);
+				sibling = getNode(parent)->right;
+			}
+			getNode(sibling)->color = getNode(parent)->color;
+			getNode(parent)->color = BLACK;
+			getNode(getNode(sibling)->right)->color = BLACK;
+			rotateLeft(h, parent);
+		}
+		else {
+			blockHeader* sibling = getNode(parent)->left;
+			if (isRed(sibling)){
+				getNode(sibling)->color = BLACK;
+				getNode(parent)->color = RED;
+				rotateRight(h, parent);
+				sibling = getNode(parent)->left;
+			}
+			if (!isRed(getNode(sibling)->left) && !isRed(getNode(sibling)->right)){
+				getNode(sibling)->color = RED;
+				child = parent;
+				parent = getNode(child)->parent;
+				continue;
+			}
+			if (!isRed(getNode(sibling)->left)){
+				getNode(getNode(sibling)->right)->color = BLACK;
+				getNode(sibling)->color = RED;
+				rotateLeft(h, sibling);
+				sibling = getNode(parent)->left;
+			}
+			getNode(sibling)->color = getNode(parent)->color;
+			getNode(parent)->color = BLACK;
+			getNode(getNode(sibling)->left)->color = BLACK;
+			rotateRight(h, parent);
+		}
+		child = h->tree_root;
+	}
+	if (child != NULL){
+		getNode(child)->color = BLACK;
+	}
+}
+
+/*
+ * Finds the smallest block in the tree that can hold size bytes, the lowest
+ * address among blocks of that size
+ *
+ * h: the heap
+ * size: the block size needed
+ * looked: incremented for every node looked at
+ *
+ * retval: the best fitting block, NULL if no block in the tree is large enough
+ */
+blockHeader* treeFindBestFit(heap* h, size_t size, int* looked){
+	blockHeader* best_fit = NULL;
+	blockHeader* current = h->tree_root;
+
+	while (current != NULL){
+		(*looked)++;
+		if (getSize(current) >= size){
+			best_fit = current;
+			current = getNode(current)->left;
+		}
+		else {
+			current = getNode(current)->right;
+		}
+	}
+	return best_fit;
+}
+#endif
+
+/*
+ * Gets the time for purge decay and capture records
+ *
+ * retval: nanoseconds since some fixed point
+ */
+long heapClock(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/*
+ * Keeps the free block counters of heap_stats() up to date
+ *
+ * h: the heap
+ * size: size of a free block
+ * joined: 1 if the block joins the bins, 0 if it leaves them
+ */
+void countFreeBlock(heap* h, size_t size, int joined){
+	int size_class = sizeof(size_t) * 8 - 1 - __builtin_clzl(size);
+
+	traceStore(&h->free_size, sizeof(size_t));
+	traceStore(&h->free_blocks, sizeof(size_t));
+	traceStore(&h->class_blocks[size_class], sizeof(size_t));
+	if (joined){
+		h->free_size += size;
+		h->free_blocks++;
+		h->class_blocks[size_class]++;
+	}
+	else {
+		h->free_size -= size;
+		h->free_blocks--;
+		h->class_blocks[size_class]--;
+	}
+}
+
+/*
+ * Finds the largest block in a large bin again after the last block of
+ * the old largest size has left it
+ *
+ * h: the heap
+ * index: the bin, at least NUM_SMALL_BINS
+ */
+void findBinMax(heap* h, int index){
+	size_t largest = 0;
+	size_t count = 0;
+
+	for (blockHeader* current = h->bins[index]; current != NULL;
+	     current = getNextFree(current)){
+		if (getSize(current) > largest){
+			largest = getSize(current);
+			count = 0;
+		}
+		if (getSize(current) == largest){
+			count++;
+		}
+	}
+	h->bin_max[index - NUM_SMALL_BINS] = largest;
+	h->bin_max_count[index - NUM_SMALL_BINS] = count;
+}
+
+/*
+ * Adds a free block to the front of the bin for its size
+ *
+ * h: the heap
+ * free_block: header of the free block
+ */
+void insertFreeBlock(heap* h, blockHeader* free_block){
+	int index = getBinIndex(getSize(free_block));
+
+	countFreeBlock(h, getSize(free_block), 1);
+	if (index >= NUM_SMALL_BINS){
+		setPurgeStamp(free_block, PURGE_DIRTY);
+	}
+
+#ifdef BEST_FIT_TREE
+	if (index >= NUM_SMALL_BINS){
+		treeInsert(h, free_block);
+		return;
+	}
+#endif
+	traceLoad(&h->bins[index], sizeof(blockHeader*));
+	setNextFree(free_block, h->bins[index]);
+	setPrevFree(free_block, NULL);
+	if (h->bins[index] != NULL){
+		setPrevFree(h->bins[index], free_block);
+	}
+	h->bins[index] = free_block;
+	h->bin_map[index / 32] |= 1u << (index % 32);
+	traceStore(&h->bins[index], sizeof(blockHeader*));
+	traceStore(&h->bin_map[index / 32], sizeof(unsigned int));
+
+	//Large bins keep their largest size for largestFreeBlock()
+	if (index >= NUM_SMALL_BINS){
+		int large = index - NUM_SMALL_BINS;
+		if (getSize(free_block) > h->bin_max[large]){
+			h->bin_max[large] = getSize(free_block);
+			h->bin_max_count[large] = 0;
+		}
+		if (getSize(free_block) == h->bin_max[large]){
+			h->bin_max_count[large]++;
+		}
+	}
+}
+
+/*
+ * Unlinks a free block from its bin
+ *
+ * h: the heap
+ * free_block: header of the free block
+ */
+void removeFreeBlock(heap* h, blockHeader* free_block){
+	int index = getBinIndex(getSize(free_block));
+
+	countFreeBlock(h, getSize(free_block), 0);
+#ifdef BEST_FIT_TREE
+	if (index >= NUM_SMALL_BINS){
+		treeRemove(h, free_block);
+		return;
+	}
+#endif
+	blockHeader* next = getNextFree(free_block);
+	blockHeader* prev = getPrevFree(free_block);
+
+	//Next fit carries on after a block that leaves the bin
+	traceLoad(&h->rovers[index], sizeof(blockHeader*));
+	if (h->rovers[index] == free_block){
+		h->rovers[index] = next;
+		traceStore(&h->rovers[index], sizeof(blockHeader*));
+	}
+	if (prev == NULL){
+		h->bins[index] = next;
+		traceStore(&h->bins[index], sizeof(blockHeader*));
+	}
+	else {
+		setNextFree(prev, next);
+	}
+	if (next != NULL){
+		setPrevFree(next, prev);
+	}
+
+	if (h->bins[index] == NULL){
+		h->bin_map[index / 32] &= ~(1u << (index % 32));
+		traceStore(&h->bin_map[index / 32], sizeof(unsigned int));
+	}
+	if (index >= NUM_SMALL_BINS &&
+	    getSize(free_block) == h->bin_max[index - NUM_SMALL_BINS] &&
+	    --h->bin_max_count[index - NUM_SMALL_BINS] == 0){
+		findBinMax(h, index);
+	}
+}
+
+/*
+ * Given the header of a block whose previous block is free returns the
+ * header of that previous block, found through its footer
+ *
+ * header: blockHeader pointer with a p-bit of 0
+ *
+ * retval: the header of the previous block
+ */
+blockHeader* getPrevHeader(blockHeader* header){
+	blockHeader* prev_footer = (blockHeader*)((void*)header - sizeof(blockHeader));
+	traceLoad(prev_footer, sizeof(blockHeader));
+	return (blockHeader*)((void*)header - prev_footer->size_status);
+}
+
+/*
+ * Given a region returns the header of its first block
+ *
+ * region: a heap region
+ *
+ * retval: the first block header of the region
+ */
+blockHeader* getFirstBlock(heapRegion* region){
+	return (blockHeader*)((void*)region + REGION_OFFSET);
+}
+
+/*
+ * Given a region returns its end mark
+ *
+ * region: a heap region
+ *
+ * retval: the end mark, the last word of the region
+ */
+blockHeader* getEndMark(heapRegion* region){
+	return (blockHeader*)((void*)region + region->size - sizeof(blockHeader));
+}
+
+/*
+ * Finds the region whose blocks hold a payload address
+ *
+ * h: the heap
+ * ptr: a payload address
+ *
+ * retval: the region containing ptr, NULL if ptr is outside the heap
+ */
+heapRegion* findRegion(heap* h, void* ptr){
+	heapRegion* region = h->regions;
+
+	while (region != NULL){
+		if ((ptr >= (void*)getFirstBlock(region) + sizeof(blockHeader)) &&
+		    (ptr < (void*)getEndMark(region))){
+			return region;
+		}
+		region = __atomic_load_n(&region->next, __ATOMIC_ACQUIRE);
+	}
+	return NULL;
+}
+
+/*
+ * Maps size bytes of zeroed memory for a region
+ *
+ * hint: preferred start address, NULL to let the kernel choose
+ * size: a multiple of the page size
+ *
+ * retval: the start of the mapping, NULL on failure
+ */
+void* mapRegion(void* hint, size_t size){
+	int fd = open("/dev/zero", O_RDWR);
+	if (-1 == fd) {
+		return NULL;
+	}
+
+	void* mmap_ptr = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == mmap_ptr) {
+		return NULL;
+	}
+	return mmap_ptr;
+}
+
+/*
+ * Maps a region of the heap. With huge pages turned on the region is
+ * backed by MAP_HUGETLB pages if the system has them reserved, otherwise
+ * it is aligned to HUGE_PAGE_SIZE and marked for transparent huge pages.
+ * If neither works the region silently gets normal pages.
+ *
+ * h: the heap
+ * hint: preferred start address, NULL to let the kernel choose
+ * size: a multiple of the page size, set to the bytes that were mapped,
+ *       which are a multiple of HUGE_PAGE_SIZE with huge pages
+ *
+ * retval: the start of the mapping, NULL on failure
+ */
+void* mapHeapRegion(heap* h, void* hint, size_t* size){
+	if (!h->huge_pages){
+		return mapRegion(hint, *size);
+	}
+	size_t huge_size = (*size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+	void* mmap_ptr = mmap(hint, huge_size, PROT_READ | PROT_WRITE,
+	                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mmap_ptr != MAP_FAILED){
+		*size = huge_size;
+		return mmap_ptr;
+	}
+#endif
+
+	//Map an extra huge page so an aligned range fits, then trim both ends
+	void* raw = mapRegion(hint, huge_size + HUGE_PAGE_SIZE);
+	if (raw == NULL){
+		return mapRegion(hint, *size);
+	}
+	uintptr_t start = ((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+	size_t lead = start - (uintptr_t)raw;
+	if (lead > 0){
+		munmap(raw, lead);
+	}
+	munmap((void*)start + huge_size, HUGE_PAGE_SIZE - lead);
+	madvise((void*)start, huge_size, MADV_HUGEPAGE);
+	*size = huge_size;
+	return (void*)start;
+}
+
+/*
+ * Sets up a newly mapped region as one big free block followed by the
+ * end mark, and appends it to the list of regions
+ *
+ * h: the heap
+ * region: start of the mapping
+ * size: bytes mapped
+ *
+ * retval: the free block covering the region
+ */
+blockHeader* initRegion(heap* h, heapRegion* region, size_t size){
+	region->next = NULL;
+	region->size = size;
+	if (h->last_region == NULL){
+		h->regions = region;
+	}
+	else {
+		//bfree() looks up regions without the heap lock, so publish the
+		//region only once its bounds are set
+		__atomic_store_n(&h->last_region->next, region, __ATOMIC_RELEASE);
+	}
+	h->last_region = region;
+
+	// Set the end mark before the free block so its p-bit can be cleared
+	getEndMark(region)->size_status = 1;
+	traceStore(getEndMark(region), sizeof(blockHeader));
+
+	// Initially the region is one free block, nothing precedes it
+	blockHeader* first_block = getFirstBlock(region);
+	size_t free_size = size - REGION_OFFSET - sizeof(blockHeader);
+	createHeader(first_block, free_size, 1, 0);
+	insertFreeBlock(h, first_block);
+
+	h->alloc_size += free_size;
+	return first_block;
+}
+
+/*
+ * Adds enough space to the heap for a block of the given size.
+ *
+ * The last region is extended in place when the kernel can do so. The new
+ * space then continues the wilderness block (the free block at the end of
+ * the region, if any), so only the missing part has to be added. Otherwise
+ * a new region is mapped. The heap grows by at least half its size each
+ * time to keep the number of regions small; untouched pages cost no memory.
+ *
+ * h: the heap
+ * size: the block size that must fit
+ *
+ * retval: a free block of at least size bytes, NULL if no memory was mapped
+ */
+blockHeader* growHeap(heap* h, size_t size){
+	//With huge pages the heap grows by whole huge pages
+	size_t pagesize = h->huge_pages ? HUGE_PAGE_SIZE : getpagesize();
+	blockHeader* end_mark = getEndMark(h->last_region);
+	size_t needed = size;
+
+	//A free block at the end of the region is extended rather than left behind
+	if (!getPBit(end_mark)){
+		needed -= getSize(getPrevHeader(end_mark));
+	}
+	needed = (needed + pagesize - 1) / pagesize * pagesize;
+
+	size_t grow = h->alloc_size / 2 / pagesize * pagesize;
+	if (grow < needed){
+		grow = needed;
+	}
+
+	//Try to extend the last region without moving it, first geometrically
+	//and then by only what is needed
+	void* moved = mremap(h->last_region, h->last_region->size, 
+			     h->last_region->size + grow, 0);
+	if (moved == MAP_FAILED && grow != needed){
+		grow = needed;
+		moved = mremap(h->last_region, h->last_region->size, 
+			       h->last_region->size + grow, 0);
+	}
+
+	if (moved != MAP_FAILED){
+		//The old end mark becomes the header of the new space
+		blockHeader* free_header = end_mark;
+		size_t free_size = grow;
+		h->last_region->size += grow;
+		h->alloc_size += grow;
+		getEndMark(h->last_region)->size_status = 1;
+		traceStore(getEndMark(h->last_region), sizeof(blockHeader));
+
+		if (!getPBit(free_header)){
+			blockHeader* prev_header = getPrevHeader(free_header);
+			removeFreeBlock(h, prev_header);
+			free_size += getSize(prev_header);
+			free_header = prev_header;
+		}
+		createHeader(free_header, free_size, getPBit(free_header), 0);
+		insertFreeBlock(h, free_header);
+		return free_header;
+	}
+
+	//Map a separate region. Asking for the address right after the last
+	//region leaves room above it, so later growth can usually use mremap().
+	void* hint = (void*)h->last_region + h->last_region->size;
+	needed = (size + REGION_OFFSET + sizeof(blockHeader) + pagesize - 1) / 
+		 pagesize * pagesize;
+	if (grow < needed){
+		grow = needed;
+	}
+	void* mmap_ptr = mapHeapRegion(h, hint, &grow);
+	if (mmap_ptr == NULL && grow != needed){
+		grow = needed;
+		mmap_ptr = mapHeapRegion(h, hint, &grow);
+	}
+	if (mmap_ptr == NULL){
+		return NULL;
+	}
+	return initRegion(h, (heapRegion*)mmap_ptr, grow);
+}
+
+/*
+ * Gives a large block its own mapping so it neither splits the heap nor
+ * stays behind in it after being freed. Called with the lock held.
+ *
+ * The mapping starts with the block's mappedBlock, the block header sits
+ * just before the first ALIGNMENT aligned address after it and the block
+ * runs to the last ALIGNMENT bytes of the mapping, so the mapping is always
+ * the block size plus MAPPED_OFFSET bytes:
+ *
+ *   | mappedBlock | pad | header | payload ... | pad |
+ *
+ * h: the heap
+ * size: the block size needed, a multiple of ALIGNMENT
+ *
+ * retval: the block header, NULL if the mapping failed
+ */
+blockHeader* mmapBlock(heap* h, size_t size){
+	size_t pagesize = getpagesize();
+	size_t map_size = (size + MAPPED_OFFSET + pagesize - 1) / pagesize * pagesize;
+
+	mappedBlock* mapped = mapRegion(NULL, map_size);
+	if (mapped == NULL){
+		return NULL;
+	}
+	mapped->owner = h;
+	mapped->mark = (uintptr_t)mapped ^ MAPPED_MAGIC;
+	mapped->prev = NULL;
+	mapped->next = h->mapped;
+	if (h->mapped != NULL){
+		h->mapped->prev = mapped;
+	}
+	h->mapped = mapped;
+	h->mapped_size += map_size;
+
+	//The block is allocated, has no previous block and is mapped
+	blockHeader* header = (blockHeader*)((void*)mapped + MAPPED_OFFSET - sizeof(blockHeader));
+	header->size_status = (map_size - MAPPED_OFFSET) + MMAP_BIT + 2 + 1;
+	return header;
+}
+
+/*
+ * Gets the mappedBlock of a block with its own mapping
+ *
+ * header: header of a mapped block
+ *
+ * retval: the start of the mapping
+ */
+mappedBlock* getMappedBlock(blockHeader* header){
+	return (mappedBlock*)((void*)header + sizeof(blockHeader) - MAPPED_OFFSET);
+}
+
+/*
+ * Unlinks a block with its own mapping from its heap and unmaps it.
+ * Called with the lock held.
+ *
+ * h: the heap
+ * header: header of a mapped block
+ */
+void unmapBlock(heap* h, blockHeader* header){
+	mappedBlock* mapped = getMappedBlock(header);
+	size_t map_size = getSize(header) + MAPPED_OFFSET;
+
+	if (mapped->prev != NULL){
+		mapped->prev->next = mapped->next;
+	}
+	else{
+		h->mapped = mapped->next;
+	}
+	if (mapped->next != NULL){
+		mapped->next->prev = mapped->prev;
+	}
+	h->mapped_size -= map_size;
+	munmap(mapped, map_size);
+}
+
+/*
+ * Function for splitting a block of heap memory when
+ * the block is larger than the amount being allocated.
+ * Creates an allocated block followed by a free block.
+ *
+ * h: the heap
+ * split_start: blockHeader pointer to the start of the block being split
+ * size: size of the memory being allocated 
+ */
+void split(heap* h, blockHeader* split_start, size_t size){
+	size_t block_size = getSize(split_start);
+	
+	//Create the allocated header
+	createHeader(split_start, size, getPBit(split_start), 1);
+	
+	//Create the free block
+	blockHeader* split_new = (blockHeader*)((void*)split_start + size);
+	createHeader(split_new, block_size-size, 1, 0);
+	insertFreeBlock(h, split_new);
+}
+
+/*
+ * Turns a requested payload size into the size of the block that holds it
+ *
+ * size: requested size for the payload
+ *
+ * retval: the block size, 0 if the request is invalid
+ */
+size_t getBlockSize(size_t size){
+	if (size < 1 || size > SIZE_MAX / 2){
+		return 0;
+	}
+
+	//Add the size of the header to the total size needed
+	size = size + sizeof(blockHeader);
+	
+	// Normalize size to memory requirements
+	if (size % ALIGNMENT != 0){
+		size = size + (ALIGNMENT - (size % ALIGNMENT)); 
+	}
+	if (size < MIN_BLOCK_SIZE){
+		size = MIN_BLOCK_SIZE;
+	}
+	return size;
+}
+
+/*
+ * Picks a free block of at least size bytes from one bin, following the
+ * heap's placement policy. Lists are in LIFO order, so the head of a bin
+ * is the block freed most recently.
+ *   PLACE_BEST_FIT   the smallest block, the one at the lowest address on
+ *                    ties as when the heap was searched in address order
+ *   PLACE_FIRST_FIT  the first block in the list
+ *   PLACE_NEXT_FIT   the first block from where the last search of the bin
+ *                    took one, wrapping around to the head of the list
+ *   PLACE_GOOD_FIT   the block at the lowest address
+ *
+ * h: the heap
+ * bin: index of a non-empty bin
+ * size: the block size needed
+ * looked: incremented for every block looked at
+ *
+ * retval: the block picked, NULL if no block in the bin is large enough
+ */
+blockHeader* findFitInBin(heap* h, int bin, size_t size, int* looked){
+	blockHeader* fit = NULL;
+	blockHeader* current;
+
+	traceLoad(&h->bins[bin], sizeof(blockHeader*));
+	if (h->placement == PLACE_NEXT_FIT){
+		traceLoad(&h->rovers[bin], sizeof(blockHeader*));
+		blockHeader* rover = h->rovers[bin] != NULL ? h->rovers[bin] : h->bins[bin];
+		for (current = rover; current != NULL; current = getNextFree(current)){
+			(*looked)++;
+			if (getSize(current) >= size){
+				return current;
+			}
+		}
+		for (current = h->bins[bin]; current != rover; current = getNextFree(current)){
+			(*looked)++;
+			if (getSize(current) >= size){
+				return current;
+			}
+		}
+		return NULL;
+	}
+
+	for (current = h->bins[bin]; current != NULL; current = getNextFree(current)){
+		size_t curr_size = getSize(current);
+		(*looked)++;
+		if (curr_size < size){
+			continue;
+		}
+		if (h->placement == PLACE_FIRST_FIT){
+			return current;
+		}
+		if (h->placement == PLACE_GOOD_FIT){
+			if (fit == NULL || current < fit){
+				fit = current;
+			}
+			continue;
+		}
+		if (fit == NULL || curr_size < getSize(fit) ||
+		    (curr_size == getSize(fit) && current < fit)){
+			fit = current;
+		}
+	}
+	return fit;
+}
+
+/*
+ * Finds a free block for a block size with the heap's placement policy,
+ * grows the heap if needed and allowed, and allocates the block, splitting
+ * off any remainder large enough to be a free block.
+ *
+ * h: the heap
+ * size: the block size, from getBlockSize()
+ *
+ * retval: the header of the allocated block, NULL if nothing fits
+ */
+blockHeader* allocateBlock(heap* h, size_t size){
+	blockHeader *best_fit = NULL;
+	int looked = 0;
+	int bin = findNonEmptyBin(h, getBinIndex(size));
+	
+	//Only bins that can hold a large enough block are searched. Every block
+	//in a later bin is larger than every block in an earlier one, so the
+	//first bin with a fit holds the best fit.
+	while (bin != -1 && best_fit == NULL){
+		best_fit = findFitInBin(h, bin, size, &looked);
+		if (best_fit != NULL && h->placement == PLACE_NEXT_FIT){
+			//Unlinking the block moves the rover on to the next one
+			h->rovers[bin] = best_fit;
+		}
+		bin = findNonEmptyBin(h, bin + 1);
+	}
+
+#ifdef BEST_FIT_TREE
+	//Large blocks are not in the bins
+	if (best_fit == NULL){
+		best_fit = treeFindBestFit(h, size, &looked);
+	}
+#endif
+
+	//Bucket i > 0 of the histogram counts searches of 2^(i-1) to 2^i - 1
+	int bucket = 0;
+	if (looked > 0){
+		bucket = sizeof(int) * 8 - __builtin_clz(looked);
+		if (bucket >= STATS_SEARCHES){
+			bucket = STATS_SEARCHES - 1;
+		}
+	}
+	h->searches[bucket]++;
+	
+	//Get more space if growth is enabled, otherwise return NULL
+	if (best_fit == NULL && h->heap_growth){
+		best_fit = growHeap(h, size);
+	}
+	if (best_fit == NULL){
+		return NULL;
+	}
+	removeFreeBlock(h, best_fit);
+	
+	//If the block is large enough to hold another free block split it
+	if (getSize(best_fit) - size >= MIN_BLOCK_SIZE){
+		split(h, best_fit, size);
+	}
+	else{
+		createHeader(best_fit, getSize(best_fit), getPBit(best_fit), 1);
+	}
+	return best_fit;
+}
+
+/*
+ * Counts the bytes of a range of pages that are in memory
+ *
+ * start: page aligned start of the range
+ * length: a multiple of the page size
+ *
+ * retval: bytes of the range backed by memory
+ */
+size_t residentBytes(void* start, size_t length){
+	size_t pagesize = getpagesize();
+	unsigned char in_core[256];
+	size_t resident = 0;
+
+	while (length > 0){
+		size_t pages = length / pagesize;
+		if (pages > sizeof(in_core)){
+			pages = sizeof(in_core);
+		}
+		if (mincore(start, pages * pagesize, in_core) != 0){
+			return resident;
+		}
+		for (size_t i = 0; i < pages; i++){
+			resident += (in_core[i] & 1) * pagesize;
+		}
+		start += pages * pagesize;
+		length -= pages * pagesize;
+	}
+	return resident;
+}
+
+/*
+ * Gives the whole pages inside a free block back to the kernel. They read
+ * as zeros and are backed by memory again once they are written to.
+ *
+ * h: the heap
+ * free_block: header of a free block of at least SMALL_BIN_LIMIT bytes
+ */
+void purgeBlock(heap* h, blockHeader* free_block){
+	uintptr_t pagesize = getpagesize();
+	uintptr_t start = ((uintptr_t)free_block + PURGE_STAMP_OFFSET + sizeof(long) +
+	                   pagesize - 1) & ~(pagesize - 1);
+	uintptr_t end = ((uintptr_t)free_block + getSize(free_block) - sizeof(blockHeader)) &
+	                ~(pagesize - 1);
+
+	setPurgeStamp(free_block, PURGE_CLEAN);
+	if (end <= start){
+		return;
+	}
+	//MADV_FREE would leave the pages counted against the process until
+	//the kernel runs short of memory
+	size_t resident = residentBytes((void*)start, end - start);
+	if (madvise((void*)start, end - start, MADV_DONTNEED) == 0){
+		h->purged_size += resident;
+	}
+}
+
+/*
+ * Purges a free block that has been free for the purge decay, or stamps
+ * the time on a block that was dirty
+ *
+ * h: the heap
+ * free_block: header of a free block of at least SMALL_BIN_LIMIT bytes
+ * now: the time of the purge pass
+ * force: 1 to purge a dirty block without waiting for the decay
+ */
+void agePurge(heap* h, blockHeader* free_block, long now, int force){
+	long stamp = getPurgeStamp(free_block);
+	if (stamp == PURGE_CLEAN){
+		return;
+	}
+	if (force || (stamp != PURGE_DIRTY && now - stamp >= h->purge_decay)){
+		purgeBlock(h, free_block);
+	}
+	else if (stamp == PURGE_DIRTY){
+		setPurgeStamp(free_block, now);
+	}
+}
+
+/*
+ * Looks at every free block of at least min_size bytes, giving back the
+ * pages of those that have been free for the purge decay. A block found
+ * dirty for the first time only gets the time stamped, so it is purged
+ * between one and two decay periods after being freed.
+ *
+ * h: the heap
+ * min_size: smallest block to look at, at least SMALL_BIN_LIMIT
+ * force: 1 to purge every dirty block without waiting for the decay
+ */
+void purgeFreeBlocks(heap* h, size_t min_size, int force){
+	long now = heapClock();
+	h->last_purge = now;
+
+	for (int bin = findNonEmptyBin(h, getBinIndex(min_size)); bin != -1;
+	     bin = findNonEmptyBin(h, bin + 1)){
+		for (blockHeader* current = h->bins[bin]; current != NULL;
+		     current = getNextFree(current)){
+			if (getSize(current) >= min_size){
+				agePurge(h, current, now, force);
+			}
+		}
+	}
+
+#ifdef BEST_FIT_TREE
+	if (h->tree_root == NULL){
+		return;
+	}
+	for (blockHeader* current = treeMinimum(h->tree_root); current != NULL;
+	     current = treeNext(current)){
+		if (getSize(current) >= min_size){
+			agePurge(h, current, now, force);
+		}
+	}
+#endif
+}
+
+/*
+ * Frees an allocated heap block, merging it with its free neighbors
+ * unless coalescing is deferred
+ *
+ * h: the heap
+ * free_header: header of an allocated block inside the heap
+ */
+void freeBlock(heap* h, blockHeader* free_header){
+	size_t free_size = getSize(free_header);
+
+	if (h->coalesce_mode == COALESCE_IMMEDIATE){
+		//Absorb the next block if it is free
+		blockHeader* next_header = getNextHeader(free_header);
+		if (isFree(next_header)){
+			removeFreeBlock(h, next_header);
+			free_size += getSize(next_header);
+			next_header->size_status = 0;
+			traceStore(next_header, sizeof(blockHeader));
+		}
+
+		//Let the previous block absorb this one if it is free. Its header
+		//is cleared so that freeing its payload again fails.
+		if (!getPBit(free_header)){
+			blockHeader* prev_header = getPrevHeader(free_header);
+			removeFreeBlock(h, prev_header);
+			free_size += getSize(prev_header);
+			free_header->size_status = 0;
+			traceStore(free_header, sizeof(blockHeader));
+			free_header = prev_header;
+		}
+	}
+
+	//Free the current header
+	createHeader(free_header, free_size, getPBit(free_header), 0);
+	insertFreeBlock(h, free_header);
+
+	//Large blocks give their pages back right away without a decay, and
+	//otherwise look at the others at most once per decay period
+	if (h->purge_threshold > 0 && free_size >= h->purge_threshold){
+		if (h->purge_decay == 0){
+			purgeBlock(h, free_header);
+		}
+		else if (heapClock() - h->last_purge >= h->purge_decay){
+			purgeFreeBlocks(h, h->purge_threshold, 0);
+		}
+	}
+}
+
+/*
+ * Finds where the first aligned payload in a block can start, leaving
+ * room in front of it for a block of its own
+ *
+ * block: header of the block
+ * alignment: a power of two larger than ALIGNMENT
+ *
+ * retval: the header of the aligned block
+ */
+blockHeader* getAlignedHeader(blockHeader* block, size_t alignment){
+	uintptr_t payload = (uintptr_t)block + sizeof(blockHeader);
+	if (payload % alignment != 0){
+		payload = (payload + MIN_BLOCK_SIZE + alignment - 1) & ~(alignment - 1);
+	}
+	return (blockHeader*)(payload - sizeof(blockHeader));
+}
+
+/*
+ * Finds a free block that already has room for an aligned block, looking
+ * only at blocks large enough to hold size bytes. Called with the lock
+ * held.
+ *
+ * h: the heap
+ * size: the block size
+ * alignment: a power of two larger than ALIGNMENT
+ *
+ * retval: the free block, NULL if none has room
+ */
+blockHeader* findAlignedFit(heap* h, size_t size, size_t alignment){
+	blockHeader* current;
+
+	for (int bin = findNonEmptyBin(h, getBinIndex(size)); bin != -1;
+	     bin = findNonEmptyBin(h, bin + 1)){
+		for (current = h->bins[bin]; current != NULL; current = getNextFree(current)){
+			if ((void*)getAlignedHeader(current, alignment) + size <=
+			    (void*)current + getSize(current)){
+				return current;
+			}
+		}
+	}
+#ifdef BEST_FIT_TREE
+	if (h->tree_root != NULL){
+		for (current = treeMinimum(h->tree_root); current != NULL;
+		     current = treeNext(current)){
+			if ((void*)getAlignedHeader(current, alignment) + size <=
+			    (void*)current + getSize(current)){
+				return current;
+			}
+		}
+	}
+#endif
+	return NULL;
+}
+
+/*
+ * Allocates a block whose payload is a multiple of alignment. A free block
+ * with room for the aligned payload is taken if there is one. Otherwise a
+ * block with room for it at any alignment is allocated, growing the heap
+ * if needed. The parts in front of and after the payload are freed again.
+ * Called with the lock held.
+ *
+ * h: the heap
+ * size: the block size, from getBlockSize()
+ * alignment: a power of two larger than ALIGNMENT
+ *
+ * retval: the header of the allocated block, NULL if nothing fits
+ */
+blockHeader* allocateAlignedBlock(heap* h, size_t size, size_t alignment){
+	blockHeader* block = findAlignedFit(h, size, alignment);
+	if (block != NULL){
+		removeFreeBlock(h, block);
+		createHeader(block, getSize(block), getPBit(block), 1);
+	}
+	else {
+		block = allocateBlock(h, size + alignment + MIN_BLOCK_SIZE);
+		if (block == NULL){
+			return NULL;
+		}
+	}
+
+	//The leading part must be large enough to be a block of its own
+	blockHeader* aligned = getAlignedHeader(block, alignment);
+	if (aligned != block){
+		size_t lead_size = (void*)aligned - (void*)block;
+
+		createHeader(aligned, getSize(block) - lead_size, 0, 1);
+		createHeader(block, lead_size, getPBit(block), 1);
+		freeBlock(h, block);
+		block = aligned;
+	}
+
+	//Give back what is left after the payload. allocateBlock() may have
+	//left a free block right after it, so it is freed to merge with that.
+	if (getSize(block) - size >= MIN_BLOCK_SIZE){
+		blockHeader* tail = (blockHeader*)((void*)block + size);
+		createHeader(tail, getSize(block) - size, 1, 1);
+		createHeader(block, size, getPBit(block), 1);
+		freeBlock(h, tail);
+	}
+	return block;
+}
+
+/*
+ * Finds the slab that a payload is a slot of
+ *
+ * h: the heap
+ * ptr: the payload
+ *
+ * retval: the slab, NULL if ptr is not a slot of one of the heap's slabs
+ */
+slab* findSlab(heap* h, void* ptr){
+	if (!h->slabs_made || ((uintptr_t)ptr % ALIGNMENT) != 0){
+		return NULL;
+	}
+	heapRegion* region = findRegion(h, ptr);
+	if (region == NULL){
+		return NULL;
+	}
+
+	slab* candidate = (slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+	blockHeader* header = (blockHeader*)((void*)candidate - sizeof(blockHeader));
+	if (header < getFirstBlock(region)){
+		return NULL;
+	}
+	traceLoad(header, sizeof(blockHeader));
+	if ((header->size_status & (SLAB_BIT + 1)) != SLAB_BIT + 1){
+		return NULL;
+	}
+	traceLoad(candidate, sizeof(slab));
+	if (candidate->mark != ((uintptr_t)candidate ^ SLAB_MAGIC)){
+		return NULL;
+	}
+
+	//Only the start of a slot counts
+	size_t offset = ptr - (void*)candidate;
+	if (offset < SLOTS_OFFSET || (offset - SLOTS_OFFSET) % candidate->size != 0 ||
+	    (offset - SLOTS_OFFSET) / candidate->size >= candidate->slots){
+		return NULL;
+	}
+	return candidate;
+}
+
+/*
+ * Takes a slot for a small request, making a new slab for its size class
+ * if none has a free slot. Called with the lock held.
+ *
+ * h: the heap
+ * size: requested size for the payload, 1 to SLAB_MAX_SIZE
+ *
+ * retval: the slot, NULL if no slab can be allocated
+ */
+void* slabAllocate(heap* h, size_t size){
+	int index = (size - 1) / ALIGNMENT;
+	slab* current = h->slabs[index];
+
+	if (current == NULL){
+		blockHeader* block = allocateAlignedBlock(h, getBlockSize(SLAB_SIZE), SLAB_SIZE);
+		if (block == NULL){
+			return NULL;
+		}
+		block->size_status += SLAB_BIT;
+		traceStore(block, sizeof(blockHeader));
+		current = (void*)block + sizeof(blockHeader);
+		current->mark = (uintptr_t)current ^ SLAB_MAGIC;
+		current->size = (index + 1) * ALIGNMENT;
+		current->slots = (SLAB_SIZE - SLOTS_OFFSET) / current->size;
+		current->used = 0;
+		memset(current->free_map, 0, sizeof(current->free_map));
+		for (unsigned int slot = 0; slot < current->slots; slot++){
+			current->free_map[slot / 64] |= 1ULL << (slot % 64);
+		}
+		current->prev = NULL;
+		current->next = NULL;
+		h->slabs[index] = current;
+		h->slabs_made = 1;
+	}
+
+	int word = 0;
+	traceLoad(current, sizeof(slab));
+	while (current->free_map[word] == 0){
+		word++;
+	}
+	int slot = word * 64 + __builtin_ctzll(current->free_map[word]);
+	current->free_map[word] &= ~(1ULL << (slot % 64));
+	traceStore(&current->free_map[word], sizeof(uint64_t));
+	traceStore(&current->used, sizeof(current->used));
+
+	//A full slab leaves the list until a slot is freed
+	if (++current->used == current->slots){
+		h->slabs[index] = current->next;
+		if (current->next != NULL){
+			current->next->prev = NULL;
+		}
+	}
+	return (void*)current + SLOTS_OFFSET + slot * current->size;
+}
+
+/*
+ * Frees a slot, giving its slab back to the heap once the slab is empty
+ * unless it is the only one of its size class with free slots. Called
+ * with the lock held.
+ *
+ * h: the heap
+ * owner: the slab, from findSlab()
+ * ptr: the slot
+ *
+ * retval: 0 on success, -1 if the slot is already free
+ */
+int slabFree(heap* h, slab* owner, void* ptr){
+	int slot = (ptr - (void*)owner - SLOTS_OFFSET) / owner->size;
+	int index = owner->size / ALIGNMENT - 1;
+
+	if (owner->free_map[slot / 64] & (1ULL << (slot % 64))){
+		return -1;
+	}
+	owner->free_map[slot / 64] |= 1ULL << (slot % 64);
+	traceStore(&owner->free_map[slot / 64], sizeof(uint64_t));
+	traceStore(&owner->used, sizeof(owner->used));
+
+	//A full slab goes back on the list
+	if (owner->used-- == owner->slots){
+		owner->prev = NULL;
+		owner->next = h->slabs[index];
+		if (owner->next != NULL){
+			owner->next->prev = owner;
+		}
+		h->slabs[index] = owner;
+	}
+
+	if (owner->used == 0 && (owner->prev != NULL || owner->next != NULL)){
+		if (owner->prev != NULL){
+			owner->prev->next = owner->next;
+		}
+		else {
+			h->slabs[index] = owner->next;
+		}
+		if (owner->next != NULL){
+			owner->next->prev = owner->prev;
+		}
+		owner->mark = 0;
+		freeBlock(h, (blockHeader*)((void*)owner - sizeof(blockHeader)));
+	}
+	return 0;
+}
+
+/*
+ * Pushes a chain of allocated blocks onto remote_frees without locking
+ *
+ * h: the heap
+ * first: first block of the chain, linked with setNextFree()
+ * last: last block of the chain
+ */
+void pushRemoteFrees(heap* h, blockHeader* first, blockHeader* last){
+	blockHeader* head = __atomic_load_n(&h->remote_frees, __ATOMIC_RELAXED);
+	do {
+		setNextFree(last, head);
+	} while (!__atomic_compare_exchange_n(&h->remote_frees, &head, first, 1,
+	                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * Pushes a block that bfree() cannot free now onto remote_frees
+ *
+ * h: the heap
+ * block: header of the block, or of the slot for a slab slot
+ *
+ * retval: 0 on success, -1 if the block is already waiting to be freed
+ */
+int pushRemoteFree(heap* h, blockHeader* block){
+	if (getPrevFree(block) == REMOTE_MARK){
+		return -1;
+	}
+	setPrevFree(block, REMOTE_MARK);
+	pushRemoteFrees(h, block, block);
+	return 0;
+}
+
+/*
+ * Frees every block pushed onto remote_frees, called with the lock held
+ */
+void drainRemoteFrees(heap* h){
+	if (__atomic_load_n(&h->remote_frees, __ATOMIC_RELAXED) == NULL){
+		return;
+	}
+
+	//Taking the whole stack at once leaves nothing for other threads to
+	//pop, so the links cannot change underneath us
+	blockHeader* block = __atomic_exchange_n(&h->remote_frees, NULL,
+	                                         __ATOMIC_ACQUIRE);
+	while (block != NULL){
+		blockHeader* next = getNextFree(block);
+
+		//Slots keep their contents when freed, so the mark is cleared
+		setPrevFree(block, NULL);
+		slab* owner = findSlab(h, (void*)block + sizeof(blockHeader));
+		if (owner != NULL){
+			slabFree(h, owner, (void*)block + sizeof(blockHeader));
+		}
+		else if (block->size_status & MMAP_BIT){
+			unmapBlock(h, block);
+		}
+		else{
+			freeBlock(h, block);
+		}
+		block = next;
+	}
+}
+
+/*
+ * Takes the heap lock in thread-safe mode and frees the blocks other
+ * threads could not free while it was held
+ */
+void lockHeap(heap* h){
+	if (h->thread_safe){
+		pthread_mutex_lock(&h->lock);
+		drainRemoteFrees(h);
+	}
+}
+
+/*
+ * Takes the heap lock if nobody holds it
+ *
+ * h: the heap
+ *
+ * retval: 1 if the lock was taken or none is needed, 0 otherwise
+ */
+int tryLockHeap(heap* h){
+	if (!h->thread_safe){
+		return 1;
+	}
+	if (pthread_mutex_trylock(&h->lock) != 0){
+		return 0;
+	}
+	drainRemoteFrees(h);
+	return 1;
+}
+
+/*
+ * Releases the heap lock in thread-safe mode
+ */
+void unlockHeap(heap* h){
+	if (h->thread_safe){
+		pthread_mutex_unlock(&h->lock);
+	}
+}
+
+/*
+ * Hands up to count blocks of one size class back to the heap, leaving
+ * them on remote_frees if the lock is busy
+ *
+ * cache: the thread's cache
+ * index: the size class, also the bin index of the block size
+ * count: how many blocks to return
+ */
+void flushCache(threadCache* cache, int index, int count){
+	heap* h = &default_heap;
+	blockHeader* first = cache->heads[index];
+	blockHeader* last = NULL;
+
+	//Cut the first count blocks off the cache, they stay linked
+	while (count > 0 && cache->heads[index] != NULL){
+		last = cache->heads[index];
+		cache->heads[index] = getNextFree(last);
+		cache->counts[index]--;
+		count--;
+	}
+	if (last == NULL){
+		return;
+	}
+	setNextFree(last, NULL);
+
+	if (!tryLockHeap(h)){
+		pushRemoteFrees(h, first, last);
+		return;
+	}
+	while (first != NULL){
+		blockHeader* next = getNextFree(first);
+		freeBlock(h, first);
+		first = next;
+	}
+	unlockHeap(h);
+}
+
+/*
+ * Hands every cached block of a thread back to the heap, run when a
+ * thread that used its cache exits
+ *
+ * cache: the exiting thread's cache
+ */
+void flushThreadCache(void* cache){
+	for (int index = 0; index < NUM_SMALL_BINS; index++){
+		flushCache((threadCache*)cache, index, CACHE_LIMIT);
+	}
+}
+
+/*
+ * Creates the key whose destructor flushes the cache of an exiting thread
+ */
+void createCacheKey(){
+	pthread_key_create(&cache_key, flushThreadCache);
+}
+
+/*
+ * Gets the calling thread's cache, making sure it is flushed when the
+ * thread exits
+ *
+ * retval: the cache
+ */
+threadCache* getThreadCache(){
+	threadCache* cache = &thread_cache;
+	if (!cache->registered){
+		pthread_once(&cache_key_once, createCacheKey);
+		pthread_setspecific(cache_key, cache);
+		cache->registered = 1;
+	}
+	return cache;
+}
+
+/*
+ * Takes a block of the given size class from the calling thread's cache,
+ * refilling the cache from the heap in one batch when it is empty
+ *
+ * size: the block size, less than SMALL_BIN_LIMIT
+ *
+ * retval: the header of an allocated block, NULL if the heap is full
+ */
+blockHeader* cacheAllocate(size_t size){
+	heap* h = &default_heap;
+	threadCache* cache = getThreadCache();
+	int index = getBinIndex(size);
+
+	if (cache->heads[index] == NULL){
+		lockHeap(h);
+		while (cache->counts[index] < CACHE_BATCH){
+			blockHeader* block = allocateBlock(h, size);
+			if (block == NULL){
+				break;
+			}
+			setNextFree(block, cache->heads[index]);
+			cache->heads[index] = block;
+			cache->counts[index]++;
+		}
+		unlockHeap(h);
+
+		if (cache->heads[index] == NULL){
+			return NULL;
+		}
+	}
+
+	blockHeader* block = cache->heads[index];
+	cache->heads[index] = getNextFree(block);
+	cache->counts[index]--;
+	setPrevFree(block, NULL);
+	return block;
+}
+
+/*
+ * Puts a block into the calling thread's cache, returning a batch to the
+ * heap when the cache for its size class is full
+ *
+ * block: header of an allocated block smaller than SMALL_BIN_LIMIT
+ *
+ * retval: 0 on success, -1 if the block is already in the cache
+ */
+int cacheFree(blockHeader* block){
+	threadCache* cache = getThreadCache();
+	int index = getBinIndex(getSize(block));
+
+	//The mark may also be left over user data, so check the cache itself
+	if (getPrevFree(block) == CACHE_MARK){
+		for (blockHeader* cached = cache->heads[index]; cached != NULL;
+		     cached = getNextFree(cached)){
+			if (cached == block){
+				return -1;
+			}
+		}
+	}
+
+	if (cache->counts[index] >= CACHE_LIMIT){
+		flushCache(cache, index, CACHE_BATCH);
+	}
+	setNextFree(block, cache->heads[index]);
+	setPrevFree(block, CACHE_MARK);
+	cache->heads[index] = block;
+	cache->counts[index]++;
+	return 0;
+}
+
+/*
+ * Turns a payload into the offset a capture records for it
+ *
+ * ptr: the payload, or NULL
+ *
+ * retval: the offset from the start of the heap, CAPTURE_NULL for NULL
+ */
+uint64_t captureOffset(void* ptr){
+	if (ptr == NULL){
+		return CAPTURE_NULL;
+	}
+	return (uint64_t)(ptr - (void*)default_heap.regions);
+}
+
+/*
+ * Copies a thread's batch into the next slot of the capture ring, waiting
+ * for the flusher to make room if the ring is full
+ *
+ * batch: the batch, which is empty afterwards
+ */
+void publishCapture(captureBatch* batch){
+	uint64_t pos = __atomic_fetch_add(&capture_head, 1, __ATOMIC_RELAXED);
+	while (pos - __atomic_load_n(&capture_tail, __ATOMIC_ACQUIRE) >= CAPTURE_RING){
+		pthread_cond_signal(&capture_wake);
+		sched_yield();
+	}
+
+	captureBatch* slot = &capture_ring[pos % CAPTURE_RING];
+	memcpy(slot->records, batch->records, batch->count * sizeof(captureRecord));
+	slot->count = batch->count;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	batch->count = 0;
+
+	//Wake the flusher early once a quarter of the ring is waiting
+	if (pos % (CAPTURE_RING / 4) == 0){
+		pthread_cond_signal(&capture_wake);
+	}
+}
+
+/*
+ * Hands on what is left in the batch of an exiting thread and stops
+ * listing it
+ *
+ * batch: the exiting thread's batch
+ */
+void releaseCaptureBatch(void* batch){
+	pthread_mutex_lock(&capture_batches_lock);
+	if (capture_on && ((captureBatch*)batch)->count > 0){
+		publishCapture(batch);
+	}
+	captureBatch** link = &capture_batches;
+	while (*link != batch){
+		link = &(*link)->next;
+	}
+	*link = ((captureBatch*)batch)->next;
+	pthread_mutex_unlock(&capture_batches_lock);
+}
+
+/*
+ * Creates the key whose destructor releases the batch of an exiting thread
+ */
+void createCaptureKey(){
+	pthread_key_create(&capture_key, releaseCaptureBatch);
+}
+
+/*
+ * Records a call in the calling thread's batch
+ *
+ * ticks: captureTicks() when the call took effect
+ * op: one of the CAPTURE_ op codes
+ * size: the size argument or result of the call
+ * ptr: the payload that was returned or freed, or NULL
+ * extra: old offset for brealloc(), alignment for balloc_aligned()
+ */
+void captureOpAt(uint64_t ticks, int op, size_t size, void* ptr, uint64_t extra){
+	captureBatch* batch = &capture_batch;
+	if (!batch->registered){
+		pthread_once(&capture_key_once, createCaptureKey);
+		pthread_setspecific(capture_key, batch);
+		pthread_mutex_lock(&capture_batches_lock);
+		batch->next = capture_batches;
+		capture_batches = batch;
+		batch->registered = 1;
+		pthread_mutex_unlock(&capture_batches_lock);
+	}
+
+	captureRecord* record = &batch->records[batch->count];
+	record->op_time = ((uint64_t)op << 56) | (ticks - capture_start_ticks);
+	record->size = size;
+	record->offset = captureOffset(ptr);
+	record->extra = extra;
+	if (++batch->count == CAPTURE_BATCH){
+		publishCapture(batch);
+	}
+}
+
+/*
+ * Records a call that has just taken effect, see captureOpAt()
+ */
+void captureOp(int op, size_t size, void* ptr, uint64_t extra){
+	captureOpAt(captureTicks(), op, size, ptr, extra);
+}
+
+/*
+ * Writes the ready batches at the tail of the capture ring to the log,
+ * at most CAPTURE_WRITE of them with one system call
+ *
+ * retval: the number of batches written
+ */
+int writeCapture(){
+	uint64_t tail = capture_tail;
+	struct iovec chunks[CAPTURE_WRITE];
+	int count = 0;
+
+	//One rate for the whole capture keeps the records in time order
+	if (capture_rate == 0){
+		long nanos = heapClock() - capture_start;
+		capture_rate = nanos > 0 ? (double)(captureTicks() - capture_start_ticks) / nanos : 1;
+	}
+
+	while (count < CAPTURE_WRITE){
+		captureBatch* slot = &capture_ring[(tail + count) % CAPTURE_RING];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + count + 1){
+			break;
+		}
+		for (int i = 0; i < slot->count; i++){
+			captureRecord* record = &slot->records[i];
+			uint64_t time = CAPTURE_TIME(*record) / capture_rate;
+			record->op_time = (record->op_time & ~((1ULL << 56) - 1)) | time;
+		}
+		chunks[count].iov_base = slot->records;
+		chunks[count].iov_len = slot->count * sizeof(captureRecord);
+		count++;
+	}
+
+	//Carry on from where a short write stopped
+	struct iovec* chunk = chunks;
+	int left = count;
+	while (left > 0){
+		ssize_t bytes = writev(capture_fd, chunk, left);
+		if (bytes <= 0){
+			break;
+		}
+		while (left > 0 && (size_t)bytes >= chunk->iov_len){
+			bytes -= chunk->iov_len;
+			chunk++;
+			left--;
+		}
+		if (left > 0){
+			chunk->iov_base += bytes;
+			chunk->iov_len -= bytes;
+		}
+	}
+	__atomic_store_n(&capture_tail, tail + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+/*
+ * Flusher thread: writes out the capture ring every CAPTURE_WAIT ms or
+ * when woken, and empties it once the capture stops
+ */
+void* flushCapture(void* arg){
+	pthread_mutex_lock(&capture_lock);
+	while (capture_on){
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_nsec += CAPTURE_WAIT * 1000000L;
+		if (until.tv_nsec >= 1000000000L){
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&capture_wake, &capture_lock, &until);
+
+		pthread_mutex_unlock(&capture_lock);
+		while (writeCapture() > 0);
+		pthread_mutex_lock(&capture_lock);
+	}
+	pthread_mutex_unlock(&capture_lock);
+
+	//Every reserved slot gets filled in, so wait for the last ones
+	while (capture_tail != __atomic_load_n(&capture_head, __ATOMIC_ACQUIRE)){
+		if (writeCapture() == 0){
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Checks that a pointer is the payload of an allocated block, either in
+ * the heap or with its own mapping
+ *
+ * h: the heap
+ * ptr: the pointer to check
+ *
+ * retval: the header of the block, NULL if ptr is NULL, not a multiple of
+ *         ALIGNMENT, outside of the heap or the payload of a free block
+ */
+blockHeader* getAllocatedHeader(heap* h, void* ptr){
+	if (ptr == NULL || ((uintptr_t)ptr % ALIGNMENT) != 0){
+		return NULL;
+	}
+	blockHeader* header = (blockHeader*)(ptr - sizeof(blockHeader));
+
+	//Check if the ptr is inside the heap space
+	if (findRegion(h, ptr) == NULL){
+		//A mapped block's payload is always MAPPED_OFFSET bytes into a
+		//page that starts with its mark. The page of a block freed before
+		//is no longer mapped, so mincore() checks that it is before the
+		//mark is read.
+		if ((uintptr_t)ptr % getpagesize() != MAPPED_OFFSET){
+			return NULL;
+		}
+		mappedBlock* mapped = getMappedBlock(header);
+		unsigned char resident;
+		if (mincore(mapped, getpagesize(), &resident) != 0 ||
+		    mapped->mark != ((uintptr_t)mapped ^ MAPPED_MAGIC) ||
+		    mapped->owner != h){
+			return NULL;
+		}
+		traceLoad(header, sizeof(blockHeader));
+		if ((header->size_status & (MMAP_BIT + 1)) != MMAP_BIT + 1){
+			return NULL;
+		}
+		return header;
+	}
+
+	//Other threads only ever change the p-bit of an allocated block's
+	//header, so this needs no lock. The block holding a slab is never
+	//handed out itself.
+	if (isFree(header) || (header->size_status & SLAB_BIT)){
+		return NULL;
+	}
+	return header;
+}
+
+/*
+ * Finds how many bytes an allocated payload can hold, see
+ * balloc_usable_size()
+ *
+ * h: the heap
+ * ptr: the pointer to check
+ *
+ * retval: the usable size, 0 if ptr is not an allocated payload of h
+ */
+size_t usableSize(heap* h, void* ptr){
+	slab* owner = findSlab(h, ptr);
+	if (owner != NULL){
+		int slot = (ptr - (void*)owner - SLOTS_OFFSET) / owner->size;
+		if (owner->free_map[slot / 64] & (1ULL << (slot % 64))){
+			return 0;
+		}
+		return owner->size;
+	}
+
+	blockHeader* header = getAllocatedHeader(h, ptr);
+	if (header == NULL){
+		return 0;
+	}
+	return getSize(header) - sizeof(blockHeader);
+}
+
+/*
+ * Allocates a block for a payload of size bytes, see balloc()
+ *
+ * h: the heap
+ * size: requested size for the payload
+ *
+ * retval: the payload, NULL if no block can be allocated
+ */
+void* allocatePayload(heap* h, size_t size){
+	if (h->use_slabs && size > 0 && size <= SLAB_MAX_SIZE){
+		lockHeap(h);
+		void* slot = slabAllocate(h, size);
+		unlockHeap(h);
+		return slot;
+	}
+
+	size = getBlockSize(size);
+	if (size == 0){
+		return NULL;
+	}
+
+	blockHeader* block;
+
+	//Large requests get their own mapping
+	if (h->mmap_threshold > 0 && size - sizeof(blockHeader) >= h->mmap_threshold){
+		lockHeap(h);
+		block = mmapBlock(h, size);
+		unlockHeap(h);
+	}
+	else if (h == &default_heap && h->thread_safe && size < SMALL_BIN_LIMIT){
+		block = cacheAllocate(size);
+	}
+	else {
+		lockHeap(h);
+		block = allocateBlock(h, size);
+		unlockHeap(h);
+	}
+
+	if (block == NULL){
+		return NULL;
+	}
+	return (void*)block + sizeof(blockHeader);
+}
+
+/* 
+ * Function for allocating 'size' bytes of heap memory.
+ * Argument size: requested size for the payload
+ * Returns address of allocated block (payload) on success.
+ * Returns NULL on failure.
+ *
+ * This function must:
+ * - Check size - Return NULL if size < 1 
+ * - Determine block size rounding up to a multiple of 16 (ALIGNMENT)
+ *   and possibly adding padding as a result.
+ *
+ * - Use BEST-FIT PLACEMENT POLICY to chose a free block
+ *
+ * - If the BEST-FIT block that is found is exact size match
+ *   - 1. Update all heap blocks as needed for any affected blocks
+ *   - 2. Return the address of the allocated block payload
+ *
+ * - If the BEST-FIT block that is found is large enough to split 
+ *   - 1. SPLIT the free block into two valid heap blocks:
+ *         1. an allocated block
+ *         2. a free block
+ *         NOTE: both blocks must meet heap block requirements 
+ *       - Update all heap block header(s) and footer(s) 
+ *              as needed for any affected blocks.
+ *   - 2. Return the address of the allocated block payload
+ *
+ *   If no free block is large enough and growth is enabled, the heap is
+ *   grown and the block is allocated from the new space.
+ *
+ *   Requests of at least mmap_threshold bytes skip the heap and are given
+ *   their own mapping instead.
+ *
+ *   In thread-safe mode small blocks come from the calling thread's cache
+ *   without taking the heap lock.
+ *
+ *   Return if NULL unable to find and allocate block for required size
+ *
+ * Note: payload address that is returned is NOT the address of the
+ *       block header.  It is the address of the start of the 
+ *       available memory for the requesterr.
+ *
+ * Tips: Be careful with pointer arithmetic and scale factors.
+ */
+void* balloc(size_t size) {     
+	void* ptr = allocatePayload(&default_heap, size);
+	if (capture_on){
+		captureOp(CAPTURE_BALLOC, size, ptr, 0);
+	}
+	return ptr;
+} 
+ 
+/*
+ * Frees the block of a payload, see bfree()
+ *
+ * h: the heap
+ * ptr: the payload
+ *
+ * retval: 0 on success, -1 if ptr is not an allocated payload
+ */
+int freePayload(heap* h, void* ptr){
+	//Slots have no header, so they are looked for first
+	slab* owner = findSlab(h, ptr);
+	if (owner != NULL){
+		if (!tryLockHeap(h)){
+			if (usableSize(h, ptr) == 0){
+				return -1;
+			}
+			return pushRemoteFree(h, ptr - sizeof(blockHeader));
+		}
+		int result = slabFree(h, owner, ptr);
+		unlockHeap(h);
+		return result;
+	}
+
+	//Find the header of the pointer
+	blockHeader* free_header = getAllocatedHeader(h, ptr);
+	if (free_header == NULL){
+		return -1;
+	}
+
+	if (h == &default_heap && h->thread_safe &&
+	    getSize(free_header) < SMALL_BIN_LIMIT &&
+	    !(free_header->size_status & MMAP_BIT)){
+		return cacheFree(free_header);
+	}
+
+	if (!tryLockHeap(h)){
+		return pushRemoteFree(h, free_header);
+	}
+	if (free_header->size_status & MMAP_BIT){
+		unmapBlock(h, free_header);
+	}
+	else{
+		freeBlock(h, free_header);
+	}
+	unlockHeap(h);
+	return 0;
+}
+
+/* 
+ * Function for freeing up a previously allocated block.
+ * Argument ptr: address of the block to be freed up.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ * This function should:
+ * - Return -1 if ptr is NULL.
+ * - Return -1 if ptr is not a multiple of 16 (ALIGNMENT).
+ * - Return -1 if ptr is outside of the heap space, unless it is a block
+ *   with its own mapping, which is unmapped.
+ * - Return -1 if ptr block is already freed.
+ * - Update header(s) and footer as needed.
+ * - Unless coalescing is deferred, merge the block with a free next
+ *   block (found through its header) and a free previous block (found
+ *   through the p-bit and its footer).
+ * - In thread-safe mode put small blocks in the calling thread's cache,
+ *   and leave other blocks for the lock holder if the heap is locked.
+ * - Free slots of slabs through their slab, which is found from ptr alone.
+ */                    
+int bfree(void *ptr) {
+	if (!capture_on){
+		return freePayload(&default_heap, ptr);
+	}
+
+	//The free is stamped before the block can be handed out again and
+	//only logged if it succeeds
+	uint64_t ticks = captureTicks();
+	int result = freePayload(&default_heap, ptr);
+	if (result == 0){
+		captureOpAt(ticks, CAPTURE_BFREE, 0, ptr, 0);
+	}
+	return result;
+} 
+
+/*
+ * Allocates a block for a payload of size bytes at an address that is a
+ * multiple of alignment, see balloc_aligned()
+ *
+ * h: the heap
+ * size: requested size for the payload
+ * alignment: a power of two larger than ALIGNMENT
+ *
+ * retval: the payload, NULL if no block can be allocated
+ */
+void* allocateAligned(heap* h, size_t size, size_t alignment){
+	size = getBlockSize(size);
+	if (size == 0 || size > SIZE_MAX / 2 - alignment - MIN_BLOCK_SIZE){
+		return NULL;
+	}
+
+	lockHeap(h);
+	blockHeader* block = allocateAlignedBlock(h, size, alignment);
+	unlockHeap(h);
+	if (block == NULL){
+		return NULL;
+	}
+	return (void*)block + sizeof(blockHeader);
+}
+
+/*
+ * Function for allocating 'size' bytes whose address is a multiple of
+ * 'alignment'.
+ * Argument size: requested size for the payload
+ * Argument alignment: a power of two
+ * Returns address of allocated block (payload) on success.
+ * Returns NULL on failure.
+ * A block with room for the payload at any alignment is allocated and
+ * the part in front of the aligned payload is freed again. The block is
+ * always taken from the heap, since mapped blocks are never aligned to
+ * more than ALIGNMENT.
+ */
+void* balloc_aligned(size_t size, size_t alignment) {
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0){
+		return NULL;
+	}
+	if (alignment <= ALIGNMENT){
+		return balloc(size);
+	}
+
+	void* ptr = allocateAligned(&default_heap, size, alignment);
+	if (capture_on){
+		captureOp(CAPTURE_ALIGNED, size, ptr, alignment);
+	}
+	return ptr;
+}
+
+/*
+ * Resizes a block that has its own mapping, letting the kernel move it.
+ * Called with the lock held.
+ *
+ * h: the heap
+ * mapped: header of the mapped block
+ * size: the new block size
+ *
+ * retval: the header of the resized block, NULL if it cannot be resized
+ */
+blockHeader* remapBlock(heap* h, blockHeader* mapped, size_t size){
+	size_t pagesize = getpagesize();
+	size_t old_map = getSize(mapped) + MAPPED_OFFSET;
+	size_t new_map = (size + MAPPED_OFFSET + pagesize - 1) / pagesize * pagesize;
+
+	if (new_map == old_map){
+		return mapped;
+	}
+	mappedBlock* moved = mremap(getMappedBlock(mapped), old_map, new_map, MREMAP_MAYMOVE);
+	if (moved == MAP_FAILED){
+		return NULL;
+	}
+
+	//The mark and the neighbors in the list still have the old address
+	moved->mark = (uintptr_t)moved ^ MAPPED_MAGIC;
+	if (moved->prev != NULL){
+		moved->prev->next = moved;
+	}
+	else{
+		h->mapped = moved;
+	}
+	if (moved->next != NULL){
+		moved->next->prev = moved;
+	}
+	mapped = (blockHeader*)((void*)moved + MAPPED_OFFSET - sizeof(blockHeader));
+	mapped->size_status = (new_map - MAPPED_OFFSET) + MMAP_BIT + 2 + 1;
+	h->mapped_size += new_map - old_map;
+	return mapped;
+}
+
+/*
+ * Resizes a heap block where it is, called with the lock held
+ *
+ * h: the heap
+ * header: header of an allocated block in the heap
+ * size: the new block size
+ *
+ * retval: 1 if the block now holds size bytes, 0 if it has to move
+ */
+int resizeBlock(heap* h, blockHeader* header, size_t size){
+	size_t block_size = getSize(header);
+
+	//Grow by absorbing the next block if it is free and large enough
+	if (size > block_size){
+		blockHeader* next_header = getNextHeader(header);
+		if (!isFree(next_header) || block_size + getSize(next_header) < size){
+			return 0;
+		}
+		removeFreeBlock(h, next_header);
+		block_size += getSize(next_header);
+		createHeader(header, block_size, getPBit(header), 1);
+	}
+
+	//Free the tail if it is large enough to be a block, merging it with
+	//the next block when that is free too
+	if (block_size - size >= MIN_BLOCK_SIZE){
+		blockHeader* tail = (blockHeader*)((void*)header + size);
+		createHeader(header, size, getPBit(header), 1);
+		createHeader(tail, block_size - size, 1, 1);
+		freeBlock(h, tail);
+	}
+	return 1;
+}
+
+/*
+ * Resizes the block of a payload, moving it if it cannot be resized where
+ * it is, see brealloc()
+ *
+ * h: the heap
+ * ptr: the payload
+ * size: requested size for the payload, not 0
+ *
+ * retval: the resized payload, NULL if it cannot be resized
+ */
+void* resizePayload(heap* h, void* ptr, size_t size){
+	//A slot keeps its place while the payload fits and moves otherwise
+	size_t slot_size = findSlab(h, ptr) != NULL ? usableSize(h, ptr) : 0;
+	if (slot_size > 0 && size <= slot_size){
+		return ptr;
+	}
+	if (slot_size > 0){
+		void* new_ptr = allocatePayload(h, size);
+		if (new_ptr == NULL){
+			return NULL;
+		}
+		memcpy(new_ptr, ptr, slot_size);
+		freePayload(h, ptr);
+		return new_ptr;
+	}
+
+	blockHeader* header = getAllocatedHeader(h, ptr);
+	size_t block_size = getBlockSize(size);
+	if (header == NULL || block_size == 0){
+		return NULL;
+	}
+
+	if (header->size_status & MMAP_BIT){
+		lockHeap(h);
+		blockHeader* mapped = remapBlock(h, header, block_size);
+		unlockHeap(h);
+		if (mapped != NULL){
+			return (void*)mapped + sizeof(blockHeader);
+		}
+	}
+	else {
+		lockHeap(h);
+		int resized = resizeBlock(h, header, block_size);
+		unlockHeap(h);
+		if (resized){
+			return ptr;
+		}
+	}
+
+	//Last resort: move the payload to a new block
+	size_t old_size = getSize(header) - sizeof(blockHeader);
+	void* new_ptr = allocatePayload(h, size);
+	if (new_ptr == NULL){
+		return NULL;
+	}
+	memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+	freePayload(h, ptr);
+	return new_ptr;
+}
+
+/*
+ * Function for changing the size of an allocated block.
+ * Argument ptr: address of an allocated block's payload, or NULL
+ * Argument size: requested size for the payload
+ * Returns address of the resized block (payload) on success, which keeps
+ * the old contents up to the smaller of the two sizes.
+ * Returns NULL on failure, leaving the old block as it was.
+ * NULL ptr is the same as balloc(size), 0 size the same as bfree(ptr).
+ * The block is shrunk where it is by freeing its tail, and grown where it
+ * is by absorbing the next block if that is free. Only when that is not
+ * enough is a new block allocated and the payload copied over.
+ */
+void* brealloc(void *ptr, size_t size) {
+	if (ptr == NULL){
+		return balloc(size);
+	}
+	if (size == 0){
+		bfree(ptr);
+		return NULL;
+	}
+
+	void* new_ptr = resizePayload(&default_heap, ptr, size);
+	if (capture_on){
+		captureOp(CAPTURE_BREALLOC, size, new_ptr, captureOffset(ptr));
+	}
+	return new_ptr;
+}
+
+/*
+ * Function for finding how many bytes an allocated block can hold.
+ * Argument ptr: address of an allocated block's payload
+ * Returns the usable size of the payload, which is at least the size
+ * that was requested.
+ * Returns 0 if ptr is not an allocated block.
+ */
+size_t balloc_usable_size(void *ptr) {
+	return usableSize(&default_heap, ptr);
+}
+
+/*
+ * Reserves a block for a mark/release arena, see arena_open()
+ *
+ * h: the heap
+ * size: bytes the arena can hand out, headers included
+ *
+ * retval: the arena, NULL if no block can be allocated
+ */
+markArena* openArena(heap* h, size_t size){
+	size_t state_size = getBlockSize(sizeof(markArena));
+	if (size > SIZE_MAX / 2 - state_size){
+		return NULL;
+	}
+	size_t block_size = getBlockSize(state_size + size);
+	if (block_size == 0){
+		return NULL;
+	}
+
+	//The arena needs a real block, so it never comes from a slab or the
+	//thread's cache
+	blockHeader* header;
+	lockHeap(h);
+	if (h->mmap_threshold > 0 && block_size - sizeof(blockHeader) >= h->mmap_threshold){
+		header = mmapBlock(h, block_size);
+	}
+	else {
+		header = allocateBlock(h, block_size);
+	}
+	if (header == NULL){
+		unlockHeap(h);
+		return NULL;
+	}
+
+	//Cut the arena's state off the front, the rest stays allocated
+	markArena* arena = (void*)header + sizeof(blockHeader);
+	arena->end = (void*)header + getSize(header);
+	arena->owner = h;
+	arena->rest = (void*)header + state_size;
+	arena->rest->size_status = (getSize(header) - state_size) + 2 + 1;
+	header->size_status = state_size + (header->size_status & (ALIGNMENT - 1));
+	unlockHeap(h);
+	return arena;
+}
+
+/*
+ * Function for reserving space that is handed out by bumping a pointer
+ * and given back all at once.
+ * Argument size: bytes the arena can hand out, including an 8 byte
+ *                header per block
+ * Returns the arena on success.
+ * Returns NULL on failure.
+ * Blocks from arena_alloc() must not be passed to bfree() or brealloc(),
+ * they are given back by arena_release() and arena_close().
+ */
+markArena* arena_open(size_t size) {
+	return openArena(&default_heap, size);
+}
+
+/*
+ * Function for reserving an arena in a heap from heap_create(), see
+ * arena_open().
+ */
+markArena* harena_open(heap *h, size_t size) {
+	return openArena(h, size);
+}
+
+/*
+ * Function for allocating 'size' bytes from an arena.
+ * Returns address of allocated block (payload) on success.
+ * Returns NULL if size < 1 or the arena has no room left, in which case
+ * the heap may still have room.
+ * Takes no lock: only the arena's owner touches the blocks in it.
+ */
+void* arena_alloc(markArena *a, size_t size) {
+	size = getBlockSize(size);
+	traceLoad(a, sizeof(markArena));
+	blockHeader* block = a->rest;
+	if (size == 0 || (void*)block == a->end || getSize(block) < size){
+		return NULL;
+	}
+
+	//A rest too small to be a block goes along with this one
+	size_t rest_size = getSize(block) - size;
+	if (rest_size < MIN_BLOCK_SIZE){
+		a->rest = a->end;
+		traceStore(&a->rest, sizeof(a->rest));
+		return (void*)block + sizeof(blockHeader);
+	}
+	a->rest = (void*)block + size;
+	a->rest->size_status = rest_size + 2 + 1;
+	block->size_status = size + 2 + 1;
+	traceStore(&a->rest, sizeof(a->rest));
+	traceStore(a->rest, sizeof(blockHeader));
+	traceStore(block, sizeof(blockHeader));
+	return (void*)block + sizeof(blockHeader);
+}
+
+/*
+ * Function for remembering how much of an arena is in use.
+ * Returns a mark for arena_release().
+ */
+void* arena_mark(markArena *a) {
+	return a->rest;
+}
+
+/*
+ * Function for giving back every block allocated from an arena after a
+ * mark was taken, in O(1).
+ * Argument mark: from arena_mark() on the same arena
+ * Returns 0 on success.
+ * Returns -1 if the mark is not inside the arena.
+ * The blocks become the arena's rest again, a single block that later
+ * calls to arena_alloc() carve up from the front.
+ */
+int arena_release(markArena *a, void *mark) {
+	void* first = (void*)a - sizeof(blockHeader) + getBlockSize(sizeof(markArena));
+	if (mark < first || mark > a->end || ((uintptr_t)mark - (uintptr_t)first) % ALIGNMENT != 0){
+		return -1;
+	}
+	if (mark < a->end){
+		((blockHeader*)mark)->size_status = (a->end - mark) + 2 + 1;
+		traceStore(mark, sizeof(blockHeader));
+	}
+	a->rest = mark;
+	traceStore(&a->rest, sizeof(a->rest));
+	return 0;
+}
+
+/*
+ * Function for giving back a whole arena to the heap it came from.
+ * The arena becomes a single free block, merged with its free neighbors
+ * unless coalescing is deferred, and must not be used again.
+ */
+void arena_close(markArena *a) {
+	heap* h = a->owner;
+	blockHeader* header = (void*)a - sizeof(blockHeader);
+
+	//Other threads may change the p-bit of the header, so it is rewritten
+	//under the lock
+	lockHeap(h);
+	header->size_status = (a->end - (void*)header) + (header->size_status & (ALIGNMENT - 1));
+	if (header->size_status & MMAP_BIT){
+		unmapBlock(h, header);
+	}
+	else{
+		freeBlock(h, header);
+	}
+	unlockHeap(h);
+}
+
+/*
+ * Merges every run of adjacent free blocks, see coalesce()
+ *
+ * h: the heap
+ *
+ * retval: 1 if there were any free blocks, 0 otherwise
+ */
+int coalesceHeap(heap* h) {
+	blockHeader* pending = NULL;
+	int coalesced = 0;
+
+	//Empty every bin into a single list of free blocks
+	for (int bin = 0; bin < NUM_BINS; bin++){
+		blockHeader* current = h->bins[bin];
+		while (current != NULL){
+			blockHeader* next = getNextFree(current);
+			setNextFree(current, pending);
+			pending = current;
+			current = next;
+		}
+		h->bins[bin] = NULL;
+	}
+	memset(h->bin_map, 0, sizeof(h->bin_map));
+	memset(h->bin_max, 0, sizeof(h->bin_max));
+	memset(h->bin_max_count, 0, sizeof(h->bin_max_count));
+	memset(h->rovers, 0, sizeof(h->rovers));
+
+#ifdef BEST_FIT_TREE
+	//Add the blocks in the tree too, visiting them in order through the
+	//parent links. The list link is not part of the tree node.
+	if (h->tree_root != NULL){
+		blockHeader* current = treeMinimum(h->tree_root);
+		while (current != NULL){
+			blockHeader* next = treeNext(current);
+			setNextFree(current, pending);
+			pending = current;
+			current = next;
+		}
+		h->tree_root = NULL;
+	}
+#endif
+
+	//Every block joins the bins again once merged
+	h->free_size = 0;
+	h->free_blocks = 0;
+	memset(h->class_blocks, 0, sizeof(h->class_blocks));
+
+	//Loop over all free blocks. Blocks that absorbed others are kept
+	//apart from those that did not.
+	blockHeader* merged = NULL;
+	blockHeader* grown = NULL;
+	while (pending != NULL){
+		blockHeader* current = pending;
+		pending = getNextFree(current);
+		coalesced = 1;
+
+		//A block after a free block is part of that block's run
+		if (!getPBit(current)){
+			continue;
+		}
+			
+		//Coalesce all adjacent blocks
+		int absorbed = isFree(getNextHeader(current));
+		while (isFree(getNextHeader(current))){
+			current->size_status += getSize(getNextHeader(current));
+			traceStore(current, sizeof(blockHeader));
+		}
+		createHeader(current, getSize(current), getPBit(current), 0);		
+		if (absorbed){
+			setNextFree(current, grown);
+			grown = current;
+		}
+		else{
+			setNextFree(current, merged);
+			merged = current;
+		}
+	}
+
+	//Rebin the blocks only once every pending link has been read, since
+	//binning a block that grew, stamp included, may write over the blocks
+	//it absorbed. A block that absorbs others has dirty pages again, which
+	//binning marks it with.
+	while (grown != NULL){
+		blockHeader* current = grown;
+		grown = getNextFree(current);
+		insertFreeBlock(h, current);
+	}
+	while (merged != NULL){
+		blockHeader* current = merged;
+		merged = getNextFree(current);
+		int large = getSize(current) >= SMALL_BIN_LIMIT;
+		long stamp = large ? getPurgeStamp(current) : PURGE_DIRTY;
+		insertFreeBlock(h, current);
+
+		//Binning marks the block dirty, which would keep it from ever
+		//aging if coalesce() is called often
+		if (large){
+			setPurgeStamp(current, stamp);
+		}
+	}
+
+	//Merged blocks may now be large enough to give their pages back
+	if (h->purge_threshold > 0){
+		purgeFreeBlocks(h, h->purge_threshold, 0);
+	}
+	return coalesced;
+}
+
+/*
+ * Function for traversing the free lists and coalescing all adjacent 
+ * free blocks.
+ *
+ * This function is used for user-called coalescing. With immediate
+ * coalescing bfree() already keeps free blocks merged, so this only has
+ * work to do for blocks freed while coalescing was deferred.
+ * Only free blocks are visited: every bin is emptied into one list and each
+ * free block whose previous block is allocated absorbs the run of free
+ * blocks that follows it. Blocks whose p-bit shows a free predecessor are
+ * absorbed by that run and skipped.
+ * Updated header size_status and footer size_status as needed.
+ * In thread-safe mode the caller's cached blocks are returned to the heap
+ * first so they can be merged too.
+ */
+int coalesce() {
+	if (default_heap.thread_safe){
+		flushThreadCache(&thread_cache);
+	}
+	lockHeap(&default_heap);
+	int coalesced = coalesceHeap(&default_heap);
+	unlockHeap(&default_heap);
+	if (capture_on){
+		captureOp(CAPTURE_COALESCE, coalesced, NULL, 0);
+	}
+	return coalesced;
+}
+
+
+ 
+/*
+ * Function for choosing which free block balloc() takes among those large
+ * enough. Each search stops at the first size class that has one.
+ * Argument policy: PLACE_BEST_FIT for the smallest block (the default)
+ *                  PLACE_FIRST_FIT for the most recently freed block
+ *                  PLACE_NEXT_FIT for the next block after the one the
+ *                  last search of that size class took
+ *                  PLACE_GOOD_FIT for the block at the lowest address
+ * With BEST_FIT_TREE, blocks too large for the exact bins are always
+ * taken best fit from the tree.
+ */
+void set_placement_policy(int policy) {
+	default_heap.placement = policy;
+}
+
+/*
+ * Function for choosing when free blocks are merged.
+ * Argument mode: COALESCE_IMMEDIATE to merge in bfree() (the default)
+ *                COALESCE_DEFERRED to leave merging to coalesce()
+ */
+void set_coalesce_mode(int mode) {
+	default_heap.coalesce_mode = mode;
+}
+
+/*
+ * Function for letting balloc() grow the heap on demand.
+ * Argument enabled: 1 to grow the heap when no free block fits,
+ *                   0 to return NULL instead (the default)
+ */
+void set_heap_growth(int enabled) {
+	default_heap.heap_growth = enabled;
+}
+
+/*
+ * Function for sending large requests straight to mmap().
+ * Argument threshold: requests of at least this many bytes get their own
+ *                     mapping that bfree() unmaps, 0 turns this off
+ *                     (the default)
+ */
+void set_mmap_threshold(size_t threshold) {
+	default_heap.mmap_threshold = threshold;
+}
+
+/*
+ * Function for serving small requests from slabs.
+ * Argument enabled: 1 to give requests of at most 256 bytes a slot in a
+ *                   page of same-size slots, 0 for blocks (the default)
+ * Slots have no header and are found through a bitmap instead of a
+ * search. Slots handed out before slabs are turned off can still be freed.
+ * In thread-safe mode small requests then take the heap lock rather than
+ * the thread caches.
+ */
+void set_slabs(int enabled) {
+	default_heap.use_slabs = enabled;
+}
 
 /*
- * Additional global variables may be added as needed below
- * TODO: add global variables needed by your function
+ * Function for backing the heap with 2 MiB huge pages, which cuts TLB
+ * misses when walking a large heap.
+ * Argument enabled: 1 to map heap regions with MAP_HUGETLB if the system
+ *                   has huge pages reserved, and otherwise aligned to
+ *                   2 MiB and marked for transparent huge pages with
+ *                   madvise(MADV_HUGEPAGE); 0 for normal pages (the
+ *                   default)
+ * Applies to regions mapped after the call, so call it before init_heap().
+ * Regions are then sized in whole huge pages. Where neither kind of huge
+ * page is available the heap silently uses normal pages.
  */
+void set_huge_pages(int enabled) {
+	default_heap.huge_pages = enabled;
+}
+
 /*
- * Given a block header pointer returns the size of the 
- * memory block.
- *
- * header: blockHeader pointer
- *
- * retval: size of the block
+ * Function for giving the memory of large free blocks back to the kernel.
+ * Argument threshold: free blocks of at least this many bytes have their
+ *                     whole pages given back with madvise() once they have
+ *                     been free for the purge decay, 0 turns this off
+ *                     (the default). Values below SMALL_BIN_LIMIT are
+ *                     raised to it.
+ * The pages are backed by memory again when the space is reused.
  */
-int getSize(blockHeader* header){
-	return (header->size_status - (header->size_status % 8));
+void set_purge_threshold(size_t threshold) {
+	if (threshold > 0 && threshold < SMALL_BIN_LIMIT){
+		threshold = SMALL_BIN_LIMIT;
+	}
+	default_heap.purge_threshold = threshold;
 }
 
 /*
- * Given a block header return the p-bit for that header
- *
- * header: blockHeader pointer
- *
- * retval: the value of the p-bit
+ * Function for choosing how long large free blocks keep their memory.
+ * Argument ms: milliseconds a block stays free before its pages are given
+ *              back, 0 to give them back as soon as it is freed (the
+ *              default)
+ * Blocks are checked when large blocks are freed and in coalesce(), at
+ * most once per decay period, so a block is purged between one and two
+ * periods after being freed. heap_purge() does not wait.
  */
-int getPBit(blockHeader* header){
-	return (header->size_status >> 1) % 2;
+void set_purge_decay(long ms) {
+	default_heap.purge_decay = ms * 1000000L;
 }
 
 /*
- * Given a block header returns whether the block is free
- *
- * header: blockHeader pointer
- *
- * retval: 1 - if free
- * 	   0 - otherwise
+ * Function for giving back the pages of every large free block now,
+ * without waiting for the purge decay. Without a purge threshold every
+ * free block of at least SMALL_BIN_LIMIT bytes is purged.
  */
-int isFree(blockHeader* header){
-	return !(header->size_status & 1);	
+void heap_purge() {
+	heap* h = &default_heap;
+	lockHeap(h);
+	purgeFreeBlocks(h, h->purge_threshold > 0 ? h->purge_threshold : SMALL_BIN_LIMIT, 1);
+	unlockHeap(h);
 }
 
 /*
- * Get the pointer to the next block header
- *
- * header: current block header
- *
- * retval: the block header of the next block
+ * Function for making balloc(), bfree() and coalesce() safe to call from
+ * several threads at once.
+ * Argument enabled: 1 to lock the heap and give each thread a cache of
+ *                   small blocks, 0 for a single thread (the default)
+ * Turning this off returns the caller's cached blocks to the heap; other
+ * threads must have exited by then.
  */
-blockHeader* getNextHeader(blockHeader* header){
-	return (blockHeader*)((void*)header + getSize(header)); 
+void set_thread_safe(int enabled) {
+	if (default_heap.thread_safe && !enabled){
+		flushThreadCache(&thread_cache);
+		//Taking the lock frees whatever is left on remote_frees
+		lockHeap(&default_heap);
+		unlockHeap(&default_heap);
+	}
+	default_heap.thread_safe = enabled;
 }
 
 /*
- * Creates a footer for a free block
- * 
- * free_block: the pointer to the header of the free block
+ * Function for recording every balloc(), balloc_aligned(), brealloc(),
+ * bfree() and coalesce() call to a file.
+ * Argument path: the log file, which is replaced
+ * Returns 0 on success.
+ * Returns -1 if a capture is already running or the file cannot be made.
+ * The log starts with CAPTURE_MAGIC followed by one captureRecord per
+ * call, see p3Heap.h. Each thread gathers its records in batches that a
+ * separate thread writes out, so callers do not wait for the file. With
+ * several threads the log is in time order per thread only, and calls
+ * that overlap in time may have their times in either order.
  */
-void createFooter(blockHeader* free_block){
-	int free_size = getSize(free_block);
+int start_capture(const char *path) {
+	if (capture_on){
+		return -1;
+	}
+	capture_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (capture_fd < 0){
+		return -1;
+	}
+	if (write(capture_fd, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != sizeof(CAPTURE_MAGIC)){
+		close(capture_fd);
+		return -1;
+	}
 
-	//Initialize footer
-	blockHeader *footer = (blockHeader*)((void*)free_block + free_size - sizeof(blockHeader*));
-	footer->size_status = free_size;
-	
-	blockHeader *next_header = getNextHeader(free_block);
-	if (getPBit(next_header)){
-		next_header->size_status -= 2;	
+	//Positions start over, so no slot may look ready from the last capture
+	memset(capture_ring, 0, sizeof(capture_ring));
+	capture_head = 0;
+	capture_tail = 0;
+	capture_rate = 0;
+	capture_start = heapClock();
+	capture_start_ticks = captureTicks();
+	capture_on = 1;
+	if (pthread_create(&capture_thread, NULL, flushCapture, NULL) != 0){
+		capture_on = 0;
+		close(capture_fd);
+		return -1;
 	}
+	return 0;
 }
 
-/* 
- * Creates a header to a memory location
- *
- * header_start: a blockHeader 
- * size: the size of the block
- * p_bit: the setting of the p-bit for the header
- * a_bit: the setting of the a-bit for the header
+/*
+ * Function for ending a capture, writing out every record first.
+ * Other threads should not be allocating while the capture stops.
  */
-void createHeader(blockHeader* header_start, int size, int p_bit, int a_bit){
-	header_start->size_status = size + (2 * p_bit) + a_bit; 
-	
-	//If this block is empty create a footer
-	if (a_bit == 0){
-		createFooter(header_start);
+void stop_capture() {
+	if (!capture_on){
+		return;
 	}
 
-	//Otherwise set the p-bit of the next header
-	else {
-		blockHeader* next_header = getNextHeader(header_start);
-		if (!(getPBit(next_header))){
-			next_header->size_status += 2;	
+	//Hand on the batches that are not full yet
+	pthread_mutex_lock(&capture_batches_lock);
+	for (captureBatch* batch = capture_batches; batch != NULL; batch = batch->next){
+		if (batch->count > 0){
+			publishCapture(batch);
 		}
 	}
+	pthread_mutex_unlock(&capture_batches_lock);
+
+	pthread_mutex_lock(&capture_lock);
+	capture_on = 0;
+	pthread_cond_signal(&capture_wake);
+	pthread_mutex_unlock(&capture_lock);
+
+	pthread_join(capture_thread, NULL);
+	close(capture_fd);
+	capture_fd = -1;
 }
 
 /*
- * Function for splitting a block of heap memory when
- * the block is larger than the amount being allocated.
- * Creates an allocated block followed by a free block.
- *
- * split_start: blockHeader pointer to the start of the block being split
- * size: size of the memory being allocated 
+ * Function for tracing every read and write the allocator makes to its own
+ * metadata: block headers and footers, free list links, tree nodes, bin
+ * heads, slab and arena headers.
+ * Argument path: the trace file, which is replaced
+ * Returns 0 on success.
+ * Returns -1 if a trace is already running, the file cannot be made or
+ * the heap was built without TRACE_METADATA.
+ * Each access is one line in the format of Valgrind's lackey tool, which
+ * p4B/csim reads, e.g. " L 7f3a9c000010,8" or " S 7f3a9c000010,8".
  */
-void split(blockHeader* split_start, int size){
-	int block_size = getSize(split_start);
-	
-	//Create the allocated header
-	createHeader(split_start, size, getPBit(split_start), 1);
-	
-	//Create the free block
-	blockHeader* split_new = (blockHeader*)((void*)split_start + size);
-	createHeader(split_new, block_size-size, 1, 0);
+int start_metadata_trace(const char *path) {
+#ifdef TRACE_METADATA
+	pthread_mutex_lock(&trace_lock);
+	if (trace_fd >= 0){
+		pthread_mutex_unlock(&trace_lock);
+		return -1;
+	}
+	trace_used = 0;
+	trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	pthread_mutex_unlock(&trace_lock);
+	return trace_fd >= 0 ? 0 : -1;
+#else
+	return -1;
+#endif
 }
 
-/* 
- * Function for allocating 'size' bytes of heap memory.
- * Argument size: requested size for the payload
- * Returns address of allocated block (payload) on success.
- * Returns NULL on failure.
- *
- * This function must:
- * - Check size - Return NULL if size < 1 
- * - Determine block size rounding up to a multiple of 8 
- *   and possibly adding padding as a result.
- *
- * - Use BEST-FIT PLACEMENT POLICY to chose a free block
- *
- * - If the BEST-FIT block that is found is exact size match
- *   - 1. Update all heap blocks as needed for any affected blocks
- *   - 2. Return the address of the allocated block payload
- *
- * - If the BEST-FIT block that is found is large enough to split 
- *   - 1. SPLIT the free block into two valid heap blocks:
- *         1. an allocated block
- *         2. a free block
- *         NOTE: both blocks must meet heap block requirements 
- *       - Update all heap block header(s) and footer(s) 
- *              as needed for any affected blocks.
- *   - 2. Return the address of the allocated block payload
- *
- *   Return if NULL unable to find and allocate block for required size
+/*
+ * Function for ending a metadata trace, writing out every access first.
+ */
+void stop_metadata_trace() {
+#ifdef TRACE_METADATA
+	pthread_mutex_lock(&trace_lock);
+	if (trace_fd >= 0){
+		flushTrace();
+		close(trace_fd);
+		trace_fd = -1;
+	}
+	pthread_mutex_unlock(&trace_lock);
+#endif
+}
+
+/*
+ * Finds the size of the largest free block: the size of the highest
+ * non-empty bin, or its largest size if it is a large bin, or with
+ * BEST_FIT_TREE the right edge of the tree.
  *
- * Note: payload address that is returned is NOT the address of the
- *       block header.  It is the address of the start of the 
- *       available memory for the requesterr.
+ * h: the heap
  *
- * Tips: Be careful with pointer arithmetic and scale factors.
+ * retval: the size of the largest free block, 0 if there is none
  */
-void* balloc(int size) {     
-	//Add the size of the header to the total size needed
-	size = size + sizeof(blockHeader);
-	
-	// Normalize size to memory requirements
-	if (size % 8 != 0){
-		size = size + (8 - (size % 8)); 
-	}
-	
-	//Initialize variables for loop
-	int curr_size;
-	blockHeader *current = heap_start;
-	blockHeader *best_fit = NULL;
-	
-	//Loop over all values from start to finish
-	while (current->size_status != 1){
-		curr_size = getSize(current);
-		
-		//If there is enough available space in the current block check if it is the best fit
-		if ((isFree(current)) && (curr_size >= size)){
-			
-			//If no matches yet set best fit to current free area
-			if (best_fit == NULL){
-				best_fit = current;
-			}
-			
-			//If the current area is closer in size set current to the best fit
-			else if (getSize(best_fit) > curr_size){
-				best_fit = current; 
-			}
-			
-			//If there is an exact fit break the loop
-			if (getSize(best_fit) == size){
-				break;
-			}
-			
+size_t largestFreeBlock(heap* h){
+#ifdef BEST_FIT_TREE
+	//Blocks in the tree are larger than any in the bins
+	if (h->tree_root != NULL){
+		blockHeader* current = h->tree_root;
+		while (getNode(current)->right != NULL){
+			current = getNode(current)->right;
 		}
-
-		//Go to the next block header
-		current = getNextHeader(current); 
-	}
-	
-	//If no block was allocated return NULL
-	if (best_fit == NULL){
-		return NULL;
-	}
-	
-	//If a block that was larger than the size needed was allocated split it
-	if (getSize(best_fit) != size){
-		split(best_fit, size);
-	}
-	else{
-		createHeader(best_fit, size, getPBit(best_fit), 1);
-	}
-	
-	return (void*)best_fit + sizeof(blockHeader);
-} 
- 
-/* 
- * Function for freeing up a previously allocated block.
- * Argument ptr: address of the block to be freed up.
- * Returns 0 on success.
- * Returns -1 on failure.
- * This function should:
- * - Return -1 if ptr is NULL.
- * - Return -1 if ptr is not a multiple of 8.
- * - Return -1 if ptr is outside of the heap space.
- * - Return -1 if ptr block is already freed.
- * - Update header(s) and footer as needed.
- */                    
-int bfree(void *ptr) {
-    	//null check the pointer	
-	if (ptr == NULL){
-		return -1;
-	}
-	
-	//Check if the pts is a multiple of 8
-	if (((unsigned int)ptr % 8) != 0){
-		return -1;
-	}
-	
-	//Check if the ptr is inside the heap space
-	if (((unsigned long int)ptr < (unsigned long int)heap_start) || (ptr > ((void*)heap_start + alloc_size - sizeof(blockHeader)))){
-		return -1;
+		return getSize(current);
 	}
-	
-	//Find the header of the pointer
-	blockHeader* free_header = (blockHeader*)(ptr - sizeof(blockHeader));
-	
-	//Check if the current header is free
-	if (isFree(free_header)){
-		return -1;
+#endif
+	for (int word = BIN_MAP_WORDS - 1; word >= 0; word--){
+		if (h->bin_map[word] == 0){
+			continue;
+		}
+		int bin = word * 32 + 31 - __builtin_clz(h->bin_map[word]);
+		if (bin < NUM_SMALL_BINS){
+			return bin * ALIGNMENT;
+		}
+		return h->bin_max[bin - NUM_SMALL_BINS];
 	}
-	
-	//Free the current header
-	createHeader(free_header, getSize(free_header), getPBit(free_header), 0);
 	return 0;
-} 
+}
 
 /*
- * Function for traversing heap block list and coalescing all adjacent 
- * free blocks.
- *
- * This function is used for user-called coalescing.
- * Updated header size_status and footer size_status as needed.
+ * Function for reading how much memory a heap holds and how it is used.
+ * Argument h: the heap
+ * Argument stats: filled in with the current figures
+ * The figures come from counters kept up to date by every call, so this
+ * takes the lock only briefly and never walks the heap. Blocks held in
+ * thread caches and slabs count as in use.
  */
-int coalesce() {
-	blockHeader* current = heap_start;
-	int coalesced = 0;
-
-	//Loop over all block headers
-	while (current->size_status != 1){
-		
-		//If there is enough available space in the current block check if it is the best fit
-		if (isFree(current)){
-			
-			//Coalesce all adjacent blocks
-			while (isFree(getNextHeader(current))){
-				current->size_status += getSize(getNextHeader(current));
-			}
-			createHeader(current, getSize(current), getPBit(current), 0);		
-			coalesced = 1;
-		}
+void hheap_stats(heap *h, heapStats *stats) {
+	lockHeap(h);
+	stats->heap_size = h->alloc_size;
+	stats->mapped_size = h->mapped_size;
+	stats->purged_size = h->purged_size;
+	stats->in_use_size = h->alloc_size - h->free_size;
+	stats->free_size = h->free_size;
+	stats->free_blocks = h->free_blocks;
+	stats->largest_free = largestFreeBlock(h);
+	memcpy(stats->class_blocks, h->class_blocks, sizeof(stats->class_blocks));
+	memcpy(stats->searches, h->searches, sizeof(stats->searches));
+	unlockHeap(h);
 
-		//Get the next block header
-		current = getNextHeader(current); 
+	stats->fragmentation = 0;
+	if (stats->free_size > 0){
+		stats->fragmentation = 1 - (double)stats->largest_free / stats->free_size;
 	}
-	return coalesced;
 }
 
- 
+/*
+ * Function for reading how much memory the allocator holds.
+ * Argument stats: filled in with the current figures, see hheap_stats()
+ */
+void heap_stats(heapStats *stats) {
+	hheap_stats(&default_heap, stats);
+}
+
 /* 
  * Function used to initialize the memory allocator.
  * Intended to be called ONLY once by a program.
@@ -353,16 +3602,13 @@ int coalesce() {
  * Returns 0 on success.
  * Returns -1 on failure.
  */                    
-int init_heap(int sizeOfRegion) {    
+int init_heap(size_t sizeOfRegion) {    
  
     static int allocated_once = 0; //prevent multiple myInit calls
  
-    int   pagesize; // page size
-    int   padsize;  // size of padding when heap size not a multiple of page size
+    size_t pagesize; // page size
+    size_t padsize;  // size of padding when heap size not a multiple of page size
     void* mmap_ptr; // pointer to memory mapped area
-    int   fd;
-
-    blockHeader* end_mark;
   
     if (0 != allocated_once) {
         fprintf(stderr, 
@@ -370,7 +3616,7 @@ int init_heap(int sizeOfRegion) {
         return -1;
     }
 
-    if (sizeOfRegion <= 0) {
+    if (sizeOfRegion == 0) {
         fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
         return -1;
     }
@@ -383,16 +3629,11 @@ int init_heap(int sizeOfRegion) {
     padsize = sizeOfRegion % pagesize;
     padsize = (pagesize - padsize) % pagesize;
 
-    alloc_size = sizeOfRegion + padsize;
+    size_t region_size = sizeOfRegion + padsize;
 
     // Using mmap to allocate memory
-    fd = open("/dev/zero", O_RDWR);
-    if (-1 == fd) {
-        fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
-        return -1;
-    }
-    mmap_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-    if (MAP_FAILED == mmap_ptr) {
+    mmap_ptr = mapHeapRegion(&default_heap, NULL, &region_size);
+    if (NULL == mmap_ptr) {
         fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
         allocated_once = 0;
         return -1;
@@ -400,36 +3641,122 @@ int init_heap(int sizeOfRegion) {
   
     allocated_once = 1;
 
-    // for double word alignment and end mark
-    alloc_size -= 8;
-
     // Initially there is only one big free block in the heap.
-    allocated_once = 1;
+    // The region header and padding in front of it keep payloads
+    // ALIGNMENT aligned, the end mark follows it.
+    heap_start = initRegion(&default_heap, (heapRegion*)mmap_ptr, region_size);
+  
+    return 0;
+} 
+                  
+/*
+ * Function for making a heap apart from the one init_heap() sets up.
+ * Argument size: the size of the heap space to be allocated.
+ * Returns the new heap on success.
+ * Returns NULL on failure.
+ * The heap has its own regions, free lists and lock, and starts with the
+ * settings of the default heap at the time of the call. It never uses
+ * thread caches, so in thread-safe mode every call takes its lock.
+ */
+heap* heap_create(size_t size) {
+	if (size == 0){
+		return NULL;
+	}
+	size_t pagesize = getpagesize();
+	size_t heap_map = (sizeof(heap) + pagesize - 1) / pagesize * pagesize;
+	size_t region_size = (size + pagesize - 1) / pagesize * pagesize;
 
-    // for double word alignment and end mark
-    alloc_size -= 8;
+	//The mapping comes zeroed, so the bins start out empty
+	heap* h = mapRegion(NULL, heap_map);
+	if (h == NULL){
+		return NULL;
+	}
+	h->heap_growth = default_heap.heap_growth;
+	h->mmap_threshold = default_heap.mmap_threshold;
+	h->purge_threshold = default_heap.purge_threshold;
+	h->purge_decay = default_heap.purge_decay;
+	h->huge_pages = default_heap.huge_pages;
+	h->use_slabs = default_heap.use_slabs;
+	h->coalesce_mode = default_heap.coalesce_mode;
+	h->placement = default_heap.placement;
+	h->thread_safe = default_heap.thread_safe;
+	pthread_mutex_init(&h->lock, NULL);
 
-    // Initially there is only one big free block in the heap.
-    // Skip first 4 bytes for double word alignment requirement.
-    heap_start = (blockHeader*) mmap_ptr + 1;
+	heapRegion* region = mapHeapRegion(h, NULL, &region_size);
+	if (region == NULL){
+		pthread_mutex_destroy(&h->lock);
+		munmap(h, heap_map);
+		return NULL;
+	}
+	initRegion(h, region, region_size);
+	return h;
+}
+
+/*
+ * Function for giving back all memory of a heap made by heap_create().
+ * Argument h: the heap, which must not be used again
+ * Every block of the heap is freed with it, including those with their
+ * own mapping. The default heap cannot be destroyed.
+ */
+void heap_destroy(heap *h) {
+	if (h == NULL || h == &default_heap){
+		return;
+	}
+	heapRegion* region = h->regions;
+	while (region != NULL){
+		heapRegion* next = region->next;
+		munmap(region, region->size);
+		region = next;
+	}
+	mappedBlock* mapped = h->mapped;
+	while (mapped != NULL){
+		mappedBlock* next = mapped->next;
+		blockHeader* header = (blockHeader*)((void*)mapped + MAPPED_OFFSET - sizeof(blockHeader));
+		munmap(mapped, getSize(header) + MAPPED_OFFSET);
+		mapped = next;
+	}
+	pthread_mutex_destroy(&h->lock);
+	munmap(h, (sizeof(heap) + getpagesize() - 1) / getpagesize() * getpagesize());
+}
 
-    // Set the end mark
-    end_mark = (blockHeader*)((void*)heap_start + alloc_size);
-    end_mark->size_status = 1;
+/*
+ * Function for allocating 'size' bytes from a heap, see balloc().
+ */
+void* hballoc(heap *h, size_t size) {
+	return allocatePayload(h, size);
+}
 
-    // Set size in header
-    heap_start->size_status = alloc_size;
+/*
+ * Function for freeing a block of a heap, see bfree().
+ * Returns -1 if ptr is not an allocated block of this heap.
+ */
+int hbfree(heap *h, void *ptr) {
+	return freePayload(h, ptr);
+}
 
-    // Set p-bit as allocated in header
-    // note a-bit left at 0 for free
-    heap_start->size_status += 2;
+/*
+ * Function for changing the size of a block of a heap, see brealloc().
+ */
+void* hbrealloc(heap *h, void *ptr, size_t size) {
+	if (ptr == NULL){
+		return allocatePayload(h, size);
+	}
+	if (size == 0){
+		freePayload(h, ptr);
+		return NULL;
+	}
+	return resizePayload(h, ptr, size);
+}
 
-    // Set the footer
-    blockHeader *footer = (blockHeader*) ((void*)heap_start + alloc_size - 4);
-    footer->size_status = alloc_size;
-  
-    return 0;
-} 
+/*
+ * Function for coalescing the free blocks of a heap, see coalesce().
+ */
+int hcoalesce(heap *h) {
+	lockHeap(h);
+	int coalesced = coalesceHeap(h);
+	unlockHeap(h);
+	return coalesced;
+}
                   
 /* 
  * Function can be used for DEBUGGING to help you visualize your heap structure.
@@ -442,21 +3769,24 @@ int init_heap(int sizeOfRegion) {
  * t_Begin  : address of the first byte in the block (where the header starts) 
  * t_End    : address of the last byte in the block 
  * t_Size   : size of the block as stored in the block header
+ * Argument h: the heap to print
  */                     
-void disp_heap() {     
+void hdisp_heap(heap* h) {     
  
     int    counter;
     char   status[6];
     char   p_status[6];
     char * t_begin = NULL;
     char * t_end   = NULL;
-    int    t_size;
+    size_t t_size;
 
-    blockHeader *current = heap_start;
+    blockHeader *current;
     counter = 1;
 
-    int used_size =  0;
-    int free_size =  0;
+    lockHeap(h);
+
+    size_t used_size =  0;
+    size_t free_size =  0;
     int is_used   = -1;
 
     fprintf(stdout, 
@@ -465,51 +3795,65 @@ void disp_heap() {
     fprintf(stdout, 
 	"---------------------------------------------------------------------------------\n");
   
-    while (current->size_status != 1) {
-        t_begin = (char*)current;
-        t_size = current->size_status;
+    for (heapRegion *region = h->regions; region != NULL; region = region->next) {
+        current = getFirstBlock(region);
+
+        while (!isEndMark(current)) {
+            t_begin = (char*)current;
+            t_size = current->size_status;
     
-        if (t_size & 1) {
-            // LSB = 1 => used block
-            strcpy(status, "alloc");
-            is_used = 1;
-            t_size = t_size - 1;
-        } else {
-            strcpy(status, "FREE ");
-            is_used = 0;
-        }
+            if (t_size & 1) {
+                // LSB = 1 => used block
+                strcpy(status, "alloc");
+                is_used = 1;
+            } else {
+                strcpy(status, "FREE ");
+                is_used = 0;
+            }
 
-        if (t_size & 2) {
-            strcpy(p_status, "alloc");
-            t_size = t_size - 2;
-        } else {
-            strcpy(p_status, "FREE ");
-        }
+            if (t_size & 2) {
+                strcpy(p_status, "alloc");
+            } else {
+                strcpy(p_status, "FREE ");
+            }
 
-        if (is_used) 
-            used_size += t_size;
-        else 
-            free_size += t_size;
+            // The other low bits mark slabs and mapped blocks
+            t_size = getSize(current);
 
-        t_end = t_begin + t_size - 1;
+            if (is_used) 
+                used_size += t_size;
+            else 
+                free_size += t_size;
+
+            t_end = t_begin + t_size - 1;
     
-        fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%4i\n", counter, status, 
-        p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
+            fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%4zu\n", counter, status, 
+            p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
     
-        current = (blockHeader*)((char*)current + t_size);
-        counter = counter + 1;
+            current = (blockHeader*)((char*)current + t_size);
+            counter = counter + 1;
+        }
     }
 
     fprintf(stdout, 
 	"---------------------------------------------------------------------------------\n");
     fprintf(stdout, 
 	"*********************************************************************************\n");
-    fprintf(stdout, "Total used size = %4d\n", used_size);
-    fprintf(stdout, "Total free size = %4d\n", free_size);
-    fprintf(stdout, "Total size      = %4d\n", used_size + free_size);
+    fprintf(stdout, "Total used size = %4zu\n", used_size);
+    fprintf(stdout, "Total free size = %4zu\n", free_size);
+    fprintf(stdout, "Total size      = %4zu\n", used_size + free_size);
     fprintf(stdout, 
 	"*********************************************************************************\n");
     fflush(stdout);
 
+    unlockHeap(h);
     return;  
 }
+
+/*
+ * Function for printing the blocks of the heap set up by init_heap(),
+ * see hdisp_heap().
+ */
+void disp_heap() {
+    hdisp_heap(&default_heap);
+}
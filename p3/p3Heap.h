@@ -8,16 +8,111 @@
 #ifndef __p3Heap_h
 #define __p3Heap_h
 
-int   init_heap(int sizeOfRegion);
+#include <stddef.h>
+#include <stdint.h>
+
+int   init_heap(size_t sizeOfRegion);
 void  disp_heap();
 
-void* balloc(int size);
+void* balloc(size_t size);
 int   bfree(void *ptr);
+void* brealloc(void *ptr, size_t size);
+void* balloc_aligned(size_t size, size_t alignment);
+size_t balloc_usable_size(void *ptr);
 int   coalesce();
 
-void* malloc(size_t size) {
-    return NULL;
-}
+#define COALESCE_IMMEDIATE 0
+#define COALESCE_DEFERRED  1
+void  set_coalesce_mode(int mode);
+#define PLACE_BEST_FIT  0
+#define PLACE_FIRST_FIT 1
+#define PLACE_NEXT_FIT  2
+#define PLACE_GOOD_FIT  3
+void  set_placement_policy(int policy);
+void  set_heap_growth(int enabled);
+void  set_mmap_threshold(size_t threshold);
+void  set_thread_safe(int enabled);
+void  set_huge_pages(int enabled);
+void  set_slabs(int enabled);
+void  set_purge_threshold(size_t threshold);
+void  set_purge_decay(long ms);
+void  heap_purge();
+
+#define STATS_CLASSES  64  // power-of-two size classes
+#define STATS_SEARCHES 16  // buckets of the search length histogram
+
+typedef struct heapStats {
+    size_t heap_size;     // usable bytes in all heap regions
+    size_t mapped_size;   // bytes mapped for blocks with their own mapping
+    size_t purged_size;   // bytes of free blocks given back to the kernel
+                          // so far
+    size_t in_use_size;   // bytes of heap blocks that are not free,
+                          // headers included
+    size_t free_size;     // bytes of free blocks
+    size_t free_blocks;   // number of free blocks
+    size_t largest_free;  // size of the largest free block
+    double fragmentation; // external fragmentation: 1 - largest_free /
+                          // free_size, 0 without free blocks
+    size_t class_blocks[STATS_CLASSES]; // free blocks of 2^i to
+                                        // 2^(i+1) - 1 bytes
+    uint64_t searches[STATS_SEARCHES];  // block allocations whose search
+                                        // looked at no free block (0) or
+                                        // at 2^(i-1) to 2^i - 1 of them,
+                                        // the last bucket counting longer
+                                        // searches too
+} heapStats;
+void  heap_stats(heapStats *stats);
+
+// A capture log is CAPTURE_MAGIC followed by one record per call
+#define CAPTURE_MAGIC    "p3heap1"
+#define CAPTURE_BALLOC   'a'
+#define CAPTURE_BFREE    'f'
+#define CAPTURE_BREALLOC 'r'
+#define CAPTURE_ALIGNED  'm'
+#define CAPTURE_COALESCE 'c'
+#define CAPTURE_NULL     UINT64_MAX
+
+typedef struct captureRecord {
+    uint64_t op_time;  // op code in the top byte, below it nanoseconds
+                       // since the capture started
+    uint64_t size;     // requested size, coalesce()'s result, 0 for bfree()
+    uint64_t offset;   // payload returned or freed, as an offset from the
+                       // start of the heap, CAPTURE_NULL for NULL
+    uint64_t extra;    // old offset for brealloc(), alignment for
+                       // balloc_aligned()
+} captureRecord;
+#define CAPTURE_OP(record)   ((int)((record).op_time >> 56))
+#define CAPTURE_TIME(record) ((record).op_time & ((1ULL << 56) - 1))
+
+int   start_capture(const char *path);
+void  stop_capture();
+
+// Builds with -DTRACE_METADATA can log each access to the heap's own
+// metadata as a Valgrind lackey trace for p4B/csim
+int   start_metadata_trace(const char *path);
+void  stop_metadata_trace();
+
+// Heaps apart from the one init_heap() sets up, each with its own regions,
+// free lists and lock. A new heap takes its settings from the default heap.
+typedef struct heap heap;
+heap* heap_create(size_t size);
+void  heap_destroy(heap *h);
+void* hballoc(heap *h, size_t size);
+int   hbfree(heap *h, void *ptr);
+void* hbrealloc(heap *h, void *ptr, size_t size);
+int   hcoalesce(heap *h);
+void  hheap_stats(heap *h, heapStats *stats);
+void  hdisp_heap(heap *h);
+
+// Mark/release allocation: an arena is one block of a heap that hands out
+// smaller blocks by bumping a pointer and takes them back all at once.
+typedef struct markArena markArena;
+markArena* arena_open(size_t size);
+markArena* harena_open(heap *h, size_t size);
+void* arena_alloc(markArena *a, size_t size);
+void* arena_mark(markArena *a);
+int   arena_release(markArena *a, void *mark);
+void  arena_close(markArena *a);
 
 #endif // __p3Heap_h__
 
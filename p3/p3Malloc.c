@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that p3Heap.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The standard allocation functions implemented on top of p3Heap, so that
+ * unmodified programs can run on this allocator:
+ *
+ *   make malloc
+ *   LD_PRELOAD=./libheapmalloc.so program
+ *
+ * The heap is set up on the first call. It is thread-safe, grows on demand
+ * and hands large requests to mmap() like glibc does.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "p3Heap.h"
+
+#define INITIAL_HEAP_SIZE (16 * 1024 * 1024)
+#define MMAP_THRESHOLD    (128 * 1024)
+
+pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Sets up the heap, run once before the first allocation
+ */
+void setupHeap(){
+	set_thread_safe(1);
+	set_heap_growth(1);
+	set_mmap_threshold(MMAP_THRESHOLD);
+	init_heap(INITIAL_HEAP_SIZE);
+}
+
+void* malloc(size_t size) {
+	pthread_once(&heap_once, setupHeap);
+
+	//malloc(0) still has to return a pointer that can be freed
+	void* ptr = balloc(size == 0 ? 1 : size);
+	if (ptr == NULL){
+		errno = ENOMEM;
+	}
+	return ptr;
+}
+
+void free(void* ptr) {
+	//Pointers that are not ours are ignored, as glibc would crash on them
+	bfree(ptr);
+}
+
+void* calloc(size_t count, size_t size) {
+	if (size != 0 && count > SIZE_MAX / size){
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	void* ptr = malloc(count * size);
+	if (ptr != NULL){
+		memset(ptr, 0, count * size);
+	}
+	return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+	if (ptr == NULL){
+		return malloc(size);
+	}
+
+	//brealloc() frees the block when size is 0, as realloc() may
+	void* new_ptr = brealloc(ptr, size);
+	if (new_ptr == NULL && size != 0){
+		errno = ENOMEM;
+	}
+	return new_ptr;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0){
+		return EINVAL;
+	}
+	pthread_once(&heap_once, setupHeap);
+
+	void* ptr = balloc_aligned(size == 0 ? 1 : size, alignment);
+	if (ptr == NULL){
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	void* ptr = NULL;
+	int error = posix_memalign(&ptr, alignment, size);
+	if (error != 0){
+		errno = error;
+	}
+	return ptr;
+}
+
+void* memalign(size_t alignment, size_t size) {
+	return aligned_alloc(alignment, size);
+}
+
+size_t malloc_usable_size(void* ptr) {
+	return balloc_usable_size(ptr);
+}
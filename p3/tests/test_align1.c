@@ -9,6 +9,6 @@ int main() {
    int* ptr = (int*) balloc(sizeof(int));
    disp_heap();
    assert(ptr != NULL);
-   assert(((int)ptr) % 8 == 0);
+   assert(((long)ptr) % 8 == 0);
    exit(0);
 }
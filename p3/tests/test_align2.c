@@ -18,7 +18,7 @@ int main() {
     }
 
     for (int i = 0; i < 4; i++) {
-        assert(((int)ptr[i]) % 8 == 0);
+        assert(((long)ptr[i]) % 8 == 0);
     }
 
     exit(0);
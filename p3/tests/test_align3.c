@@ -22,7 +22,7 @@ int main() {
     }
 
     for (int i = 0; i < 9; i++) {
-        assert(((int)ptr[i]) % 8 == 0);
+        assert(((long)ptr[i]) % 8 == 0);
     }
     exit(0);
 }
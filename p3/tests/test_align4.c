@@ -0,0 +1,28 @@
+// payloads are 16-byte aligned for SSE/AVX data
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "p3Heap.h"
+
+int main() {
+    assert(init_heap(4096) == 0);
+    void* ptr[9];
+    ptr[0] = balloc(1);
+    ptr[1] = balloc(14);
+    ptr[2] = balloc(33);
+    ptr[3] = balloc(8);
+    ptr[4] = balloc(16);
+    ptr[5] = balloc(17);
+    ptr[6] = balloc(24);
+    ptr[7] = balloc(100);
+    ptr[8] = balloc(55);
+    assert(bfree(ptr[2]) == 0);
+    ptr[2] = balloc(20);
+    for (int i = 0; i < 9; i++) {
+        assert(ptr[i] != NULL);
+    }
+    for (int i = 0; i < 9; i++) {
+        assert(((uintptr_t)ptr[i]) % 16 == 0);
+    }
+    exit(0);
+}
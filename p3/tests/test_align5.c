@@ -0,0 +1,26 @@
+// balloc_aligned() gives back what it does not use as few free blocks
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "p3Heap.h"
+
+int main() {
+    assert(init_heap(8192) == 0);
+    heapStats stats;
+
+    assert(balloc(100) != NULL);
+    void* ptr = balloc_aligned(200, 256);
+    assert(ptr != NULL);
+    assert(((uintptr_t)ptr) % 256 == 0);
+
+    // the part in front of the payload and the rest of the heap after it
+    heap_stats(&stats);
+    assert(stats.free_blocks == 2);
+    assert(stats.largest_free > 7000);
+
+    // freeing it merges everything after the first block again
+    assert(bfree(ptr) == 0);
+    heap_stats(&stats);
+    assert(stats.free_blocks == 1);
+    exit(0);
+}
@@ -0,0 +1,26 @@
+// a heap region larger than 2 GiB holds a single block larger than 2 GiB
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+int main() {
+   size_t gib = 1024UL * 1024 * 1024;
+   assert(init_heap(3 * gib) == 0);
+
+   char* big = balloc(2 * gib + gib / 2);
+   assert(big != NULL);
+
+   // touch both ends of the block
+   big[0] = 1;
+   big[2 * gib + gib / 2 - 1] = 2;
+   assert(big[0] + big[2 * gib + gib / 2 - 1] == 3);
+
+   void* small = balloc(100);
+   assert(small != NULL);
+   assert(balloc(gib) == NULL);
+
+   assert(bfree(big) == 0);
+   assert(balloc(gib) != NULL);
+
+   exit(0);
+}
@@ -0,0 +1,64 @@
+// a capture logs every call with its size and offset, in order
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   assert(start_capture("test_capture1.log") == 0);
+   assert(start_capture("test_capture1.log") == -1);
+
+   void * ptr[3];
+   ptr[0] = balloc(100);
+   ptr[1] = balloc(5000);
+   ptr[2] = balloc_aligned(40, 256);
+   ptr[0] = brealloc(ptr[0], 200);
+   assert(bfree(ptr[0]) == 0);
+   assert(bfree(ptr[0]) == -1);
+   coalesce();
+   stop_capture();
+
+   // not logged any more
+   assert(bfree(ptr[2]) == 0);
+
+   FILE * log = fopen("test_capture1.log", "rb");
+   assert(log != NULL);
+   char magic[sizeof(CAPTURE_MAGIC)];
+   assert(fread(magic, sizeof(magic), 1, log) == 1);
+   assert(memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0);
+
+   captureRecord record[7];
+   assert(fread(record, sizeof(captureRecord), 7, log) == 6);
+   fclose(log);
+   remove("test_capture1.log");
+
+   assert(CAPTURE_OP(record[0]) == CAPTURE_BALLOC);
+   assert(record[0].size == 100);
+   uint64_t first = record[0].offset;
+
+   // failed calls are logged with a NULL result
+   assert(CAPTURE_OP(record[1]) == CAPTURE_BALLOC);
+   assert(record[1].size == 5000);
+   assert(record[1].offset == CAPTURE_NULL);
+
+   assert(CAPTURE_OP(record[2]) == CAPTURE_ALIGNED);
+   assert(record[2].extra == 256);
+   // offsets count from the page aligned start of the heap
+   assert(record[2].offset % 256 == 0);
+
+   assert(CAPTURE_OP(record[3]) == CAPTURE_BREALLOC);
+   assert(record[3].size == 200);
+   assert(record[3].extra == first);
+
+   // the failed free is not logged
+   assert(CAPTURE_OP(record[4]) == CAPTURE_BFREE);
+   assert(record[4].offset == record[3].offset);
+   assert(CAPTURE_OP(record[5]) == CAPTURE_COALESCE);
+
+   for (int i = 1; i < 6; i++)
+       assert(CAPTURE_TIME(record[i]) >= CAPTURE_TIME(record[i - 1]));
+
+   exit(0);
+}
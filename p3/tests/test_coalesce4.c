@@ -0,0 +1,33 @@
+// a block merged into its free neighbors cannot be freed again
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   void * ptr[3];
+
+   ptr[0] = balloc(40);
+   ptr[1] = balloc(40);
+   ptr[2] = balloc(40);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+
+   // ptr[1] is absorbed by the free block of ptr[0]
+   assert(bfree(ptr[0]) == 0);
+   assert(bfree(ptr[1]) == 0);
+   assert(bfree(ptr[1]) == -1);
+   assert(bfree(ptr[0]) == -1);
+
+   // ptr[2] absorbs the free block after it and is absorbed by the one
+   // before it
+   assert(bfree(ptr[2]) == 0);
+   assert(bfree(ptr[2]) == -1);
+
+   // the merged block is handed out once
+   ptr[0] = balloc(40);
+   assert(ptr[0] != NULL);
+   ptr[1] = balloc(40);
+   assert(ptr[1] != NULL && ptr[1] != ptr[0]);
+
+   exit(0);
+}
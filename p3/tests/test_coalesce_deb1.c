@@ -5,6 +5,7 @@
 
 int main() {
    assert(init_heap(4096) == 0);
+   set_coalesce_mode(COALESCE_DEFERRED); // blocks stay separate until coalesce()
    void * ptr[4];
 
    ptr[0] = balloc(800);
@@ -9,6 +9,7 @@ int main() {
    int size = 1020;
 
    assert(init_heap(4096) == 0);
+   set_coalesce_mode(COALESCE_DEFERRED); // blocks stay separate until coalesce()
    void * ptr[15];
    ptr[0] = balloc(size);
 
@@ -5,11 +5,12 @@
 
 int main() {
    assert(init_heap(4096) == 0);
+   set_coalesce_mode(COALESCE_DEFERRED); // blocks stay separate until coalesce()
    void * ptr[9];
-   ptr[0] = balloc(1);
-   ptr[1] = (balloc(5));
-   ptr[2] = (balloc(8));
-   void *p3 = ptr[3] = (balloc(14));
+   ptr[0] = balloc(18);
+   ptr[1] = (balloc(26));
+   ptr[2] = (balloc(32));
+   void *p3 = ptr[3] = (balloc(44));
    assert(ptr[0] != NULL);
    assert(ptr[1] != NULL);
    assert(ptr[2] != NULL);
@@ -19,22 +20,22 @@ int main() {
    assert(bfree(ptr[0]) == 0);
    assert(bfree(ptr[3]) == 0);
    
-   assert((ptr[3] = balloc(13)) == p3);
+   assert((ptr[3] = balloc(42)) == p3);
 
-   ptr[4] = (balloc(1));
-   ptr[5] = (balloc(4));
+   ptr[4] = (balloc(18));
+   ptr[5] = (balloc(24));
    assert(ptr[4] != NULL);
    assert(ptr[5] != NULL);
    assert(bfree(ptr[5]) == 0);
    
-   ptr[6] = (balloc(9));
-   ptr[7] = (balloc(33));
+   ptr[6] = (balloc(34));
+   ptr[7] = (balloc(82));
    assert(ptr[6] != NULL);
    assert(ptr[7] != NULL);
    
    assert(bfree(ptr[4]) == 0);
 
-   ptr[8] = (balloc(55));
+   ptr[8] = (balloc(126));
    assert(ptr[8] != NULL);
 
    assert(bfree(ptr[2]) == 0);
@@ -42,7 +43,7 @@ int main() {
    assert(bfree(ptr[8]) == 0);
    assert(bfree(ptr[6]) == 0);
 
-   assert(balloc(5) < ptr[8]);
+   assert(balloc(26) < ptr[8]);
 
    exit(0);
 }
@@ -0,0 +1,32 @@
+// allocations larger than the initial heap succeed once growth is enabled
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+int main() {
+   set_heap_growth(1);
+   assert(init_heap(4096) == 0);
+   void * ptr[4];
+
+   ptr[0] = balloc(1);
+   assert(ptr[0] != NULL);
+
+   // too big for the initial heap
+   ptr[1] = balloc(4095);
+   assert(ptr[1] != NULL);
+   assert(((long)ptr[1]) % 8 == 0);
+   *(int*)ptr[1] = 42;
+   assert(*(int*)ptr[1] == 42);
+
+   ptr[2] = balloc(100000);
+   assert(ptr[2] != NULL);
+
+   assert(bfree(ptr[1]) == 0);
+   assert(bfree(ptr[2]) == 0);
+   assert(bfree(ptr[2]) == -1);
+
+   ptr[3] = balloc(50000);
+   assert(ptr[3] != NULL);
+
+   exit(0);
+}
@@ -0,0 +1,50 @@
+// heaps made by heap_create are independent of each other and of the default heap
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   set_mmap_threshold(64 * 1024);
+   heap * a = heap_create(4096);
+   heap * b = heap_create(4096);
+   assert(a != NULL && b != NULL);
+
+   // each heap has room of its own
+   void * p = balloc(4000);
+   void * q = hballoc(a, 4000);
+   void * r = hballoc(b, 4000);
+   assert(p != NULL && q != NULL && r != NULL);
+   assert(hballoc(a, 100) == NULL);
+   memset(q, 'a', 4000);
+   memset(r, 'b', 4000);
+
+   // blocks can only be freed through their own heap
+   assert(hbfree(b, q) == -1);
+   assert(bfree(q) == -1);
+   assert(hbfree(a, p) == -1);
+   assert(hbfree(a, q) == 0);
+   assert(hbfree(a, q) == -1);
+   assert(hballoc(a, 4000) == q);
+
+   // mapped blocks belong to their heap too
+   char * big = hballoc(b, 100000);
+   assert(big != NULL);
+   assert(bfree(big) == -1);
+   big = hbrealloc(b, big, 1000000);
+   assert(big != NULL);
+   big[999999] = 'z';
+   assert(hbfree(b, big) == 0);
+
+   // destroying a heap leaves the others alone
+   heap_destroy(a);
+   for (int i = 0; i < 4000; i++)
+       assert(((char*)r)[i] == 'b');
+   assert(bfree(p) == 0);
+   assert(hbfree(b, r) == 0);
+   assert(hcoalesce(b) == 1);
+   heap_destroy(b);
+
+   exit(0);
+}
@@ -0,0 +1,34 @@
+// heaps backed by huge pages are mapped in whole huge pages and still work
+// the same, whether or not the system has huge pages
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   set_huge_pages(1);
+   set_heap_growth(1);
+   assert(init_heap(4096) == 0);
+   heapStats stats;
+   heap_stats(&stats);
+   assert(stats.heap_size > 2 * 1024 * 1024 - 4096);
+   assert(stats.heap_size < 2 * 1024 * 1024);
+
+   // the heap starts on a huge page boundary, so the first payload is
+   // just past one
+   char * first = balloc(1000);
+   assert(first != NULL);
+   assert(((long)first) % (2 * 1024 * 1024) < 64);
+
+   // growing adds whole huge pages
+   char * big = balloc(3 * 1024 * 1024);
+   assert(big != NULL);
+   memset(big, 'x', 3 * 1024 * 1024);
+   heap_stats(&stats);
+   assert(stats.heap_size > 4 * 1024 * 1024 - 4096);
+   assert(bfree(big) == 0);
+   assert(bfree(first) == 0);
+   assert(coalesce() == 1);
+
+   exit(0);
+}
@@ -0,0 +1,59 @@
+// the malloc() family works when loaded with LD_PRELOAD=../libheapmalloc.so
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+   // malloc(0) gives a block that can be freed
+   void * ptr = malloc(0);
+   assert(ptr != NULL);
+   free(ptr);
+   free(NULL);
+
+   // usable size covers the request
+   char * str = malloc(100);
+   assert(str != NULL);
+   assert(malloc_usable_size(str) >= 100);
+   memset(str, 'a', 100);
+
+   // realloc keeps the contents when it moves the block
+   str = realloc(str, 5000);
+   assert(str != NULL);
+   for (int i = 0; i < 100; i++)
+       assert(str[i] == 'a');
+
+   // calloc zeroes memory, even memory that was used before
+   free(str);
+   long * zero = calloc(1000, sizeof(long));
+   assert(zero != NULL);
+   for (int i = 0; i < 1000; i++)
+       assert(zero[i] == 0);
+   size_t count = SIZE_MAX / 2;
+   assert(calloc(count, 4) == NULL);
+
+   // aligned payloads
+   void * aligned[4];
+   for (int i = 0; i < 4; i++) {
+       assert(posix_memalign(&aligned[i], 64 << i * 2, 300) == 0);
+       assert(((uintptr_t)aligned[i]) % (64 << i * 2) == 0);
+       memset(aligned[i], 1, 300);
+   }
+   assert(posix_memalign(&ptr, 24, 8) != 0);
+
+   // more than the initial heap and large mapped blocks
+   void * big[64];
+   for (int i = 0; i < 64; i++) {
+       big[i] = malloc(i % 2 ? 1000000 : 100000);
+       assert(big[i] != NULL);
+       memset(big[i], i, 100000);
+   }
+   for (int i = 0; i < 64; i++)
+       free(big[i]);
+   for (int i = 0; i < 4; i++)
+       free(aligned[i]);
+   free(zero);
+
+   exit(0);
+}
@@ -0,0 +1,58 @@
+// arena blocks are bumped off the front and released to a mark all at once
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   void * before = balloc(100);
+   markArena * a = arena_open(1024);
+   assert(a != NULL);
+   void * after = balloc(100);
+   assert(after != NULL);
+
+   // blocks follow each other, each with its own header
+   char * p = arena_alloc(a, 40);
+   char * q = arena_alloc(a, 40);
+   assert(p != NULL && q == p + 48);
+   assert(balloc_usable_size(q) == 40);
+   memset(p, 'p', 40);
+
+   // everything after the mark goes back and is handed out again
+   void * mark = arena_mark(a);
+   for (int i = 0; i < 10; i++)
+       assert(arena_alloc(a, 50) != NULL);
+   assert(arena_release(a, mark) == 0);
+   assert(arena_alloc(a, 50) == q + 48);
+   assert(arena_release(a, mark) == 0);
+   for (int i = 0; i < 40; i++)
+       assert(p[i] == 'p');
+
+   // the arena never hands out more than it holds
+   assert(arena_alloc(a, 2000) == NULL);
+   assert(arena_alloc(a, 1024 - 96 - 8) != NULL);
+   assert(arena_alloc(a, 1) == NULL);
+   assert(arena_release(a, p + 4) == -1);
+   assert(arena_release(a, before) == -1);
+
+   // closing gives the whole arena back as one block, which merges with
+   // its free neighbors
+   assert(bfree(before) == 0);
+   assert(bfree(after) == 0);
+   arena_close(a);
+   void * whole = balloc(4000);
+   assert(whole != NULL);
+   assert(bfree(whole) == 0);
+
+   // a small arena is a real block even when small requests use slabs
+   set_slabs(1);
+   a = arena_open(100);
+   assert(a != NULL);
+   p = arena_alloc(a, 40);
+   assert(p != NULL && balloc_usable_size(p) == 40);
+   arena_close(a);
+   assert(balloc(4000) == whole);
+
+   exit(0);
+}
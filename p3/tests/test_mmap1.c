@@ -0,0 +1,38 @@
+// large allocations get their own mapping and leave the heap untouched
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+int main() {
+   set_mmap_threshold(64 * 1024);
+   assert(init_heap(4096) == 0);
+   void * ptr[4];
+
+   // far larger than the heap
+   ptr[0] = balloc(1000000);
+   assert(ptr[0] != NULL);
+   assert(((long)ptr[0]) % 8 == 0);
+   *(int*)ptr[0] = 42;
+   assert(*(int*)ptr[0] == 42);
+
+   // the whole heap is still available
+   ptr[1] = balloc(4000);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = balloc(200000);
+   assert(ptr[2] != NULL);
+
+   assert(bfree(ptr[0]) == 0);
+   assert(bfree(ptr[2]) == 0);
+   assert(bfree(ptr[1]) == 0);
+
+   // freeing a mapped block twice fails without touching its old pages
+   assert(bfree(ptr[0]) == -1);
+   assert(bfree(ptr[2]) == -1);
+   assert(balloc_usable_size(ptr[0]) == 0);
+
+   // requests below the threshold still come from the heap
+   assert(balloc(5000) == NULL);
+
+   exit(0);
+}
@@ -0,0 +1,54 @@
+// each placement policy picks its own block from the same free list
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+heap* h;
+void *a, *b, *c;
+
+// Frees three blocks of 208 bytes at rising addresses, in that order, so
+// the list of their bin holds c, b, a
+void setup(int policy) {
+   set_placement_policy(policy);
+   h = heap_create(64 * 1024);
+   assert(h != NULL);
+   a = hballoc(h, 200);
+   assert(hballoc(h, 8) != NULL);
+   b = hballoc(h, 200);
+   assert(hballoc(h, 8) != NULL);
+   c = hballoc(h, 200);
+   assert(hballoc(h, 8) != NULL);
+   assert(a < b && b < c);
+   assert(hbfree(h, a) == 0);
+   assert(hbfree(h, b) == 0);
+   assert(hbfree(h, c) == 0);
+}
+
+int main() {
+   assert(init_heap(4096) == 0);
+
+   // best fit takes the lowest of equally good blocks
+   setup(PLACE_BEST_FIT);
+   assert(hballoc(h, 200) == a);
+   assert(hballoc(h, 200) == b);
+   heap_destroy(h);
+
+   setup(PLACE_FIRST_FIT);
+   assert(hballoc(h, 200) == c);
+   heap_destroy(h);
+
+   setup(PLACE_GOOD_FIT);
+   assert(hballoc(h, 200) == a);
+   heap_destroy(h);
+
+   // the rover moves on past each block taken and wraps around
+   setup(PLACE_NEXT_FIT);
+   assert(hballoc(h, 200) == c);
+   assert(hballoc(h, 200) == b);
+   assert(hballoc(h, 200) == a);
+   assert(hbfree(h, b) == 0);
+   assert(hballoc(h, 200) == b);
+   heap_destroy(h);
+
+   exit(0);
+}
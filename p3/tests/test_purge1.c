@@ -0,0 +1,71 @@
+// large free blocks give their pages back to the kernel
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4 * 1024 * 1024) == 0);
+   set_purge_threshold(256 * 1024);
+   heapStats stats;
+
+   // small blocks keep their pages
+   char * small = balloc(100 * 1024);
+   void * guard = balloc(16);
+   memset(small, 's', 100 * 1024);
+   assert(bfree(small) == 0);
+   heap_stats(&stats);
+   assert(stats.purged_size == 0);
+
+   // without a decay a large block is purged when it is freed
+   char * big = balloc(1024 * 1024);
+   memset(big, 'b', 1024 * 1024);
+   assert(bfree(big) == 0);
+   heap_stats(&stats);
+   assert(stats.purged_size >= 1000 * 1024);
+   assert(stats.purged_size <= 1024 * 1024);
+
+   // the space is reused, and its pages come back when written to
+   big = balloc(1024 * 1024);
+   assert(big != NULL);
+   memset(big, 'c', 1024 * 1024);
+   assert(big[512 * 1024] == 'c');
+
+   // with a decay blocks stay untouched until they are old enough
+   size_t before = stats.purged_size;
+   set_purge_decay(20);
+   assert(bfree(big) == 0);
+   heap_stats(&stats);
+   assert(stats.purged_size == before);
+   struct timespec wait = {0, 50 * 1000000};
+   nanosleep(&wait, NULL);
+   assert(coalesce() == 1);
+   nanosleep(&wait, NULL);
+   assert(coalesce() == 1);
+   heap_stats(&stats);
+   assert(stats.purged_size > before);
+
+   // heap_purge does not wait, and purged pages are not counted again
+   before = stats.purged_size;
+   heap_purge();
+   heap_stats(&stats);
+   assert(stats.purged_size == before);
+   assert(bfree(guard) == 0);
+
+   // deferred frees are merged into a block big enough for a stamp, which
+   // must not overwrite the links of the blocks it absorbs
+   set_coalesce_mode(COALESCE_DEFERRED);
+   void * ptr[4];
+   ptr[0] = balloc(40);
+   ptr[1] = balloc(40);
+   ptr[2] = balloc(920);
+   ptr[3] = balloc(40);
+   assert(bfree(ptr[0]) == 0);
+   assert(bfree(ptr[1]) == 0);
+   assert(bfree(ptr[2]) == 0);
+   assert(coalesce() == 1);
+   assert(balloc(1000) == ptr[0]);
+
+   exit(0);
+}
@@ -0,0 +1,50 @@
+// brealloc resizes in place when it can and keeps the contents when it moves
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   set_mmap_threshold(64 * 1024);
+
+   // grow into the free space after the block
+   char * str = brealloc(NULL, 100);
+   assert(str != NULL);
+   memset(str, 'a', 100);
+   char * grown = brealloc(str, 1000);
+   assert(grown == str);
+   for (int i = 0; i < 100; i++)
+       assert(grown[i] == 'a');
+
+   // shrinking frees the tail, so the next block fits right after it
+   assert(brealloc(grown, 40) == grown);
+   void * next = balloc(200);
+   assert(next == grown + 48);
+
+   // no room behind the block any more, so it moves
+   char * moved = brealloc(grown, 500);
+   assert(moved != NULL && moved != grown);
+   for (int i = 0; i < 40; i++)
+       assert(moved[i] == 'a');
+
+   // the old block was freed and can be reused
+   assert(balloc(30) == grown);
+
+   // mapped blocks are resized by the kernel
+   char * big = balloc(100000);
+   assert(big != NULL);
+   big[99999] = 'z';
+   big = brealloc(big, 1000000);
+   assert(big != NULL);
+   assert(big[99999] == 'z');
+   big[999999] = 'y';
+   assert(bfree(big) == 0);
+
+   // size 0 frees, bad pointers fail
+   assert(brealloc(next, 0) == NULL);
+   assert(bfree(next) == -1);
+   assert(brealloc(moved + 8, 10) == NULL);
+
+   exit(0);
+}
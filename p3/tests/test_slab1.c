@@ -0,0 +1,65 @@
+// small requests come from slabs: slots without headers, found by bitmap
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(64 * 1024) == 0);
+   set_slabs(1);
+
+   // slots of one size class sit right next to each other
+   char * a = balloc(8);
+   char * b = balloc(16);
+   char * c = balloc(10);
+   assert(a != NULL && b == a + 16 && c == b + 16);
+   assert(((long)a) % 16 == 0);
+   assert(balloc_usable_size(a) == 16);
+
+   // other classes get slabs of their own
+   char * d = balloc(100);
+   assert(d != NULL && balloc_usable_size(d) == 112);
+   assert(d < a || d > a + 4096);
+
+   // freed slots are reused first, double frees fail
+   assert(bfree(b) == 0);
+   assert(bfree(b) == -1);
+   assert(bfree(a + 8) == -1);
+   assert(balloc(1) == b);
+
+   // a full slab does not stop allocations of its class
+   void * slots[600];
+   for (int i = 0; i < 600; i++) {
+      slots[i] = balloc(32);
+      assert(slots[i] != NULL);
+      memset(slots[i], i, 32);
+   }
+   for (int i = 0; i < 600; i++) {
+      assert(*(unsigned char*)slots[i] == (unsigned char)i);
+      assert(bfree(slots[i]) == 0);
+   }
+
+   // growing past the slot moves the payload into a block
+   memset(c, 'c', 10);
+   char * moved = brealloc(c, 1000);
+   assert(moved != NULL && moved != c);
+   assert(moved[9] == 'c');
+   assert(brealloc(d, 50) == d);
+
+   // larger requests still get regular blocks
+   void * big = balloc(300);
+   assert(big != NULL && balloc_usable_size(big) == 312);
+   assert(bfree(big) == 0);
+   assert(bfree(moved) == 0);
+   assert(bfree(d) == 0);
+
+   // a slab fits in any free block with room for an aligned page, even
+   // one of less than twice the slab size
+   heap * h = heap_create(16384);
+   assert(h != NULL);
+   assert(hballoc(h, 8150) != NULL);
+   assert(hballoc(h, 32) != NULL);
+   heap_destroy(h);
+
+   exit(0);
+}
@@ -0,0 +1,103 @@
+// heap_stats() counters follow every balloc, bfree and coalesce
+#include <assert.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+// Checks the figures that must always agree with each other
+void check(heapStats * s) {
+   size_t blocks = 0;
+   for (int i = 0; i < STATS_CLASSES; i++) {
+      blocks += s->class_blocks[i];
+   }
+   assert(blocks == s->free_blocks);
+   assert(s->in_use_size + s->free_size == s->heap_size);
+   assert(s->largest_free <= s->free_size);
+}
+
+uint64_t searches(heapStats * s) {
+   uint64_t total = 0;
+   for (int i = 0; i < STATS_SEARCHES; i++) {
+      total += s->searches[i];
+   }
+   return total;
+}
+
+int main() {
+   heapStats s;
+   assert(init_heap(4096) == 0);
+   heap_stats(&s);
+   check(&s);
+   assert(s.free_blocks == 1);
+   assert(s.largest_free == s.free_size);
+   assert(s.fragmentation == 0);
+   size_t heap_size = s.heap_size;
+
+   void * a = balloc(100);
+   void * b = balloc(100);
+   void * c = balloc(100);
+   assert(a != NULL && b != NULL && c != NULL);
+   heap_stats(&s);
+   check(&s);
+   assert(s.in_use_size == 3 * 112);
+   assert(searches(&s) == 3);
+
+   // a hole in front of the rest of the heap fragments it
+   assert(bfree(a) == 0);
+   heap_stats(&s);
+   check(&s);
+   assert(s.free_blocks == 2);
+   assert(s.class_blocks[6] == 1);
+   assert(s.largest_free == heap_size - 3 * 112);
+   assert(s.fragmentation > 0 && s.fragmentation < 0.1);
+
+   // freed neighbors are counted as one block
+   assert(bfree(b) == 0);
+   heap_stats(&s);
+   check(&s);
+   assert(s.free_blocks == 2);
+   assert(s.class_blocks[6] == 0 && s.class_blocks[7] == 1);
+
+   // with deferred coalescing blocks count apart until coalesce()
+   set_coalesce_mode(COALESCE_DEFERRED);
+   assert(bfree(c) == 0);
+   heap_stats(&s);
+   check(&s);
+   assert(s.free_blocks == 3);
+   assert(coalesce() == 1);
+   heap_stats(&s);
+   check(&s);
+   assert(s.free_blocks == 1);
+   assert(s.free_size == heap_size);
+   assert(s.fragmentation == 0);
+
+   // a request nothing fits still counts as a search
+   assert(balloc(8192) == NULL);
+   heap_stats(&s);
+   assert(searches(&s) == 4);
+
+   // the largest block is still known once it leaves a bin that holds
+   // smaller blocks of the same power-of-two range
+   heap * h = heap_create(8192);
+   assert(h != NULL);
+   void * x = hballoc(h, 1800);
+   assert(hballoc(h, 8) != NULL);
+   void * y = hballoc(h, 1496);
+   assert(hballoc(h, 8) != NULL);
+   hheap_stats(h, &s);
+   assert(hballoc(h, s.largest_free - 8) != NULL);
+   assert(hbfree(h, x) == 0);
+   assert(hbfree(h, y) == 0);
+   hheap_stats(h, &s);
+   check(&s);
+   assert(s.free_blocks == 2 && s.largest_free == 1808);
+   assert(hballoc(h, 1800) == x);
+   hheap_stats(h, &s);
+   assert(s.largest_free == 1504);
+   assert(hbfree(h, x) == 0);
+   assert(hballoc(h, 1496) == y);
+   hheap_stats(h, &s);
+   assert(s.largest_free == 1808);
+   heap_destroy(h);
+
+   exit(0);
+}
@@ -0,0 +1,59 @@
+// several threads allocate and free at once without corrupting the heap
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+#define THREADS 4
+#define ROUNDS  2000
+#define LIVE    64
+
+void* worker(void* arg) {
+   long id = (long)arg;
+   void * ptr[LIVE] = {NULL};
+
+   for (int i = 0; i < ROUNDS; i++) {
+       int slot = i % LIVE;
+       if (ptr[slot] != NULL) {
+           // nobody else wrote into this block
+           assert(*(long*)ptr[slot] == id);
+           assert(bfree(ptr[slot]) == 0);
+       }
+       // mix cached small sizes with sizes that always take the lock
+       ptr[slot] = balloc(i % 3 == 0 ? 1500 : 8 + (i % 200));
+       assert(ptr[slot] != NULL);
+       assert(((long)ptr[slot]) % 16 == 0);
+       *(long*)ptr[slot] = id;
+   }
+
+   for (int i = 0; i < LIVE; i++) {
+       assert(bfree(ptr[i]) == 0);
+   }
+   return NULL;
+}
+
+int main() {
+   set_thread_safe(1);
+   assert(init_heap(1024 * 1024) == 0);
+   pthread_t threads[THREADS];
+
+   for (long i = 0; i < THREADS; i++) {
+       assert(pthread_create(&threads[i], NULL, worker, (void*)i) == 0);
+   }
+   for (int i = 0; i < THREADS; i++) {
+       assert(pthread_join(threads[i], NULL) == 0);
+   }
+
+   // cached blocks of exited threads went back, so it all merges again
+   void * ptr = balloc(1000000);
+   assert(ptr != NULL);
+
+   // a block in the cache cannot be freed twice
+   void * small = balloc(40);
+   assert(small != NULL);
+   assert(bfree(ptr) == 0);
+   assert(bfree(small) == 0);
+   assert(bfree(small) == -1);
+
+   exit(0);
+}
@@ -0,0 +1,56 @@
+// blocks allocated by one thread and freed by another all get back to the heap
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+#define BLOCKS 20000
+#define QUEUE  256
+
+// single producer, single consumer ring of blocks to free
+void * queue[QUEUE];
+long head = 0;
+long tail = 0;
+
+void* producer(void* arg) {
+   for (long i = 0; i < BLOCKS; i++) {
+       void * ptr = balloc(i % 2 ? 2000 : 24 + (i % 300));
+       assert(ptr != NULL);
+       *(long*)ptr = i;
+       while (head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == QUEUE)
+           ;
+       queue[head % QUEUE] = ptr;
+       __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+   }
+   return NULL;
+}
+
+void* consumer(void* arg) {
+   for (long i = 0; i < BLOCKS; i++) {
+       while (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail)
+           ;
+       void * ptr = queue[tail % QUEUE];
+       assert(*(long*)ptr == i);
+       assert(bfree(ptr) == 0);
+       __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+   }
+   return NULL;
+}
+
+int main() {
+   set_thread_safe(1);
+   assert(init_heap(1024 * 1024) == 0);
+   pthread_t threads[2];
+
+   assert(pthread_create(&threads[0], NULL, producer, NULL) == 0);
+   assert(pthread_create(&threads[1], NULL, consumer, NULL) == 0);
+   assert(pthread_join(threads[0], NULL) == 0);
+   assert(pthread_join(threads[1], NULL) == 0);
+
+   // every block was freed, even those left for the lock holder
+   void * ptr = balloc(1000000);
+   assert(ptr != NULL);
+   assert(bfree(ptr) == 0);
+
+   exit(0);
+}
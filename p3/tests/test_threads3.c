@@ -0,0 +1,60 @@
+// a block waiting on remote_frees for the lock holder cannot be freed again
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "p3Heap.h"
+
+// disp_heap() holds the lock while it writes to stdout, which is a full
+// pipe until main reads from it
+void* holder(void* arg) {
+   disp_heap();
+   return NULL;
+}
+
+int main() {
+   set_thread_safe(1);
+   set_slabs(1);
+   set_mmap_threshold(64 * 1024);
+   assert(init_heap(64 * 1024) == 0);
+   void * big = balloc(100000);
+   void * slot = balloc(32);
+   assert(big != NULL && slot != NULL);
+
+   int fds[2];
+   assert(pipe(fds) == 0);
+   int saved = dup(1);
+   assert(dup2(fds[1], 1) == 1);
+   fcntl(fds[1], F_SETFL, O_NONBLOCK);
+   char fill[4096] = {0};
+   while (write(fds[1], fill, sizeof(fill)) > 0)
+      ;
+   fcntl(fds[1], F_SETFL, 0);
+
+   pthread_t thread;
+   assert(pthread_create(&thread, NULL, holder, NULL) == 0);
+   struct timespec wait = {0, 100 * 1000000};
+   nanosleep(&wait, NULL);
+
+   // both are pushed for the lock holder, the second free of each fails
+   assert(bfree(big) == 0);
+   assert(bfree(big) == -1);
+   assert(bfree(slot) == 0);
+   assert(bfree(slot) == -1);
+
+   close(fds[1]);
+   assert(dup2(saved, 1) == 1);
+   while (read(fds[0], fill, sizeof(fill)) > 0)
+      ;
+   assert(pthread_join(thread, NULL) == 0);
+
+   // the lock holder freed them once
+   heapStats stats;
+   heap_stats(&stats);
+   assert(stats.mapped_size == 0);
+   assert(balloc(32) == slot);
+
+   exit(0);
+}
@@ -0,0 +1,46 @@
+// a heap built with TRACE_METADATA logs its metadata accesses for csim
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "p3Heap.h"
+
+int main() {
+   assert(init_heap(4096) == 0);
+   assert(start_metadata_trace("test_trace1.trace") == 0);
+   assert(start_metadata_trace("test_trace1.trace") == -1);
+   char * p = balloc(100);
+   assert(p != NULL);
+   assert(bfree(p) == 0);
+   stop_metadata_trace();
+
+   // nothing is traced once the trace stops
+   assert(balloc(100) == p);
+
+   // every line is a lackey load or store of a word or less, and the
+   // header of the block is both written and read
+   FILE * trace = fopen("test_trace1.trace", "r");
+   assert(trace != NULL);
+   char type;
+   unsigned long addr;
+   unsigned int len;
+   int loads = 0, stores = 0, header_read = 0, header_written = 0;
+   while (fscanf(trace, " %c %lx,%u", &type, &addr, &len) == 3) {
+      assert(type == 'L' || type == 'S');
+      assert(len >= 1 && len <= 8);
+      if (type == 'L') {
+         loads++;
+      } else {
+         stores++;
+      }
+      if ((char *)addr == p - 8) {
+         header_read |= type == 'L';
+         header_written |= type == 'S';
+      }
+   }
+   assert(feof(trace));
+   fclose(trace);
+   assert(loads > 0 && stores > 0);
+   assert(header_read && header_written);
+
+   exit(0);
+}
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that csim.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * csim-convert.c:
+ * Turns a Valgrind lackey text trace into the binary trace format of
+ * csim-trace.h, which csim reads without parsing any text. Every access
+ * csim would replay keeps its address and length, so both traces give the
+ * same output.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "csim-trace.h"
+
+/*
+ * write_varint:
+ * Appends value to out as a varint.
+ * Returns the number of bytes written, at most 10.
+ */
+int write_varint(unsigned char* out, unsigned long long value) {
+    int n = 0;
+    while (value >= 0x80) {
+        out[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = value;
+    return n;
+}
+
+/*
+ * write_header:
+ * Writes the magic and the record count at the start of the output.
+ */
+void write_header(FILE* out, unsigned long long count) {
+    unsigned char header[BIN_TRACE_HEADER];
+    memcpy(header, BIN_TRACE_MAGIC, BIN_TRACE_MAGIC_LEN);
+    for (int i = BIN_TRACE_MAGIC_LEN; i < BIN_TRACE_HEADER; i++) {
+        header[i] = count & 0xff;
+        count >>= 8;
+    }
+    if (fseek(out, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+        fprintf(stderr, "Error: cannot write the header: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <text trace> <binary trace>\n", argv[0]);
+        printf("\nExamples:\n");
+        printf("  linux>  %s traces/trace5 traces/trace5.bin\n", argv[0]);
+        exit(1);
+    }
+
+    trace_reader trace;
+    open_trace(&trace, argv[1]);
+    if (trace.binary) {
+        fprintf(stderr, "Error: %s is already a binary trace\n", argv[1]);
+        exit(1);
+    }
+    FILE* out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+        exit(1);
+    }
+    write_header(out, 0);
+
+    unsigned long long count = 0;
+    unsigned long long last_addr = 0;
+    char type;
+    while (next_access(&trace, &type)) {
+        unsigned char record[21];
+        int n = 1;
+        int op = type == 'L' ? BIN_OP_L : type == 'S' ? BIN_OP_S :
+                 type == 'M' ? BIN_OP_M : BIN_OP_I;
+
+        if (trace.len < BIN_LEN_VARINT) {
+            record[0] = op | trace.len << 2;
+        }
+        else {
+            record[0] = op | BIN_LEN_VARINT << 2;
+            n += write_varint(record + n, trace.len);
+        }
+        //Zigzag encoding keeps small steps down in memory short too
+        long long delta = trace.addr - last_addr;
+        n += write_varint(record + n, ((unsigned long long)delta << 1) ^ (delta >> 63));
+        last_addr = trace.addr;
+
+        if (fwrite(record, 1, n, out) != n) {
+            fprintf(stderr, "Error: cannot write %s: %s\n", argv[2], strerror(errno));
+            exit(1);
+        }
+        count++;
+    }
+    write_header(out, count);
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: cannot write %s: %s\n", argv[2], strerror(errno));
+        exit(1);
+    }
+
+    fprintf(stderr, "%llu accesses, %zu bytes of text\n", count, trace.size);
+    close_trace(&trace);
+    return 0;
+}
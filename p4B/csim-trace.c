@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that csim.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * csim-trace.c:
+ * Reads the accesses of a trace, text or binary, for csim and csim-convert.
+ * The file is mapped and parsed in place.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csim-trace.h"
+
+/*
+ * map_trace:
+ * Maps the whole trace file into memory so it can be parsed in place.
+ * Files that cannot be mapped, such as pipes, are read into a heap buffer
+ * instead.
+ */
+void map_trace(trace_reader* trace, char* trace_fn) {
+    int fd = open(trace_fn, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
+        exit(1);
+    }
+    trace->data = NULL;
+    trace->size = 0;
+    trace->mapped = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return;
+        }
+        char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            trace->data = data;
+            trace->size = st.st_size;
+            trace->mapped = 1;
+            return;
+        }
+    }
+
+    size_t capacity = 1 << 20;
+    char* data = malloc(capacity);
+    ssize_t got;
+    while (data != NULL && (got = read(fd, data + trace->size, capacity - trace->size)) > 0) {
+        trace->size += got;
+        if (trace->size == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+    }
+    if (data == NULL) {
+        fprintf(stderr, "%s: %s\n", trace_fn, strerror(ENOMEM));
+        exit(1);
+    }
+    close(fd);
+    trace->data = data;
+}
+
+/*
+ * Value of each character as a hex digit, 16 for characters that are not
+ */
+unsigned char hex_value[256];
+
+void init_hex_value() {
+    memset(hex_value, 16, sizeof(hex_value));
+    for (int i = 0; i < 10; i++) {
+        hex_value['0' + i] = i;
+    }
+    for (int i = 0; i < 6; i++) {
+        hex_value['a' + i] = 10 + i;
+        hex_value['A' + i] = 10 + i;
+    }
+}
+
+/*
+ * parse_access:
+ * Parses "<hex addr>,<decimal len>" from p up to end, the way
+ * sscanf("%llx,%u") does for every well-formed line.
+ * Returns 1 and sets *addr and *len on success, 0 if the text is anything
+ * else (signs, overflow, missing fields), which the caller leaves to
+ * sscanf() so the results stay the same.
+ */
+int parse_access(const char* p, const char* end, unsigned long long* addr, unsigned int* len) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    const char* digits = p;
+    unsigned long long a = 0;
+    while (p < end && hex_value[(unsigned char)*p] < 16) {
+        a = (a << 4) | hex_value[(unsigned char)*p];
+        p++;
+    }
+    if (p == digits || p - digits > 16 || p == end || *p != ',') {
+        return 0;
+    }
+    p++;
+
+    digits = p;
+    unsigned long l = 0;
+    while (p < end && (unsigned char)(*p - '0') < 10) {
+        l = l * 10 + (*p - '0');
+        p++;
+    }
+    if (p == digits || p - digits > 9) {
+        return 0;
+    }
+    *addr = a;
+    *len = l;
+    return 1;
+}
+
+/*
+ * open_trace:
+ * Opens a trace file and finds out which format it is in.
+ */
+void open_trace(trace_reader* trace, char* trace_fn) {
+    map_trace(trace, trace_fn);
+    trace->p = trace->data;
+    trace->end = trace->data + trace->size;
+    trace->binary = 0;
+    trace->left = 0;
+    trace->addr = 0;
+    trace->len = 0;
+    trace->text_addr = 0;
+    trace->text_len = 0;
+    init_hex_value();
+
+    if (trace->size >= BIN_TRACE_HEADER &&
+        memcmp(trace->data, BIN_TRACE_MAGIC, BIN_TRACE_MAGIC_LEN) == 0) {
+        trace->binary = 1;
+        for (int i = BIN_TRACE_HEADER - 1; i >= BIN_TRACE_MAGIC_LEN; i--) {
+            trace->left = (trace->left << 8) | (unsigned char)trace->data[i];
+        }
+        trace->p += BIN_TRACE_HEADER;
+    }
+}
+
+/*
+ * read_varint:
+ * Reads a varint of a binary trace.
+ * Returns 0 if the trace ends in the middle of it.
+ */
+int read_varint(trace_reader* trace, unsigned long long* value) {
+    int shift = 0;
+    *value = 0;
+    while (trace->p < trace->end && shift < 64) {
+        unsigned char byte = *trace->p++;
+        *value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+/*
+ * next_binary_access:
+ * Reads the next record of a binary trace, see next_access().
+ */
+int next_binary_access(trace_reader* trace, char* type) {
+    unsigned long long len, delta;
+
+    if (trace->left == 0) {
+        return 0;
+    }
+    unsigned char byte = trace->p < trace->end ? *trace->p++ : 0;
+    len = byte >> 2;
+    if (trace->p == trace->end ||
+        (len == BIN_LEN_VARINT && !read_varint(trace, &len)) ||
+        !read_varint(trace, &delta)) {
+        fprintf(stderr, "Warning: the trace ends %llu records early\n", trace->left);
+        trace->left = 0;
+        return 0;
+    }
+    trace->addr += (delta >> 1) ^ -(delta & 1);
+    trace->len = len;
+    trace->left--;
+    *type = "LSMI"[byte & 3];
+    return 1;
+}
+
+/*
+ * next_text_access:
+ * Reads the next access of a text trace, see next_access().
+ *
+ * Lines are split where fgets() into a 1000 byte buffer would split them,
+ * and a data access whose fields cannot be read keeps those of the last
+ * one, as sscanf() leaves them, so csim's output is the same as when it
+ * read the file that way. Instruction loads are returned too but never
+ * change what the next data access keeps.
+ */
+int next_text_access(trace_reader* trace, char* type) {
+    char buf[1000];
+
+    while (trace->p < trace->end) {
+        const char* p = trace->p;
+        const char* limit = trace->end - p > 999 ? p + 999 : trace->end;
+        const char* eol = memchr(p, '\n', limit - p);
+        const char* next = eol != NULL ? eol + 1 : limit;
+        char op = next - p >= 2 ? p[1] : '\0';
+        trace->p = next;
+
+        if (op == 'S' || op == 'L' || op == 'M') {
+            if (next - p >= 3 &&
+                !parse_access(p + 3, next, &trace->text_addr, &trace->text_len)) {
+                memcpy(buf, p, next - p);
+                buf[next - p] = '\0';
+                sscanf(buf + 3, "%llx,%u", &trace->text_addr, &trace->text_len);
+            }
+            trace->addr = trace->text_addr;
+            trace->len = trace->text_len;
+            *type = op;
+            return 1;
+        }
+        if (p[0] == 'I' && parse_access(p + 1, next, &trace->addr, &trace->len)) {
+            *type = 'I';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * next_access:
+ * Reads the next access of a trace.
+ * Returns 1 and sets *type to L, S, M or I and trace->addr and trace->len
+ * to the access, 0 at the end of the trace.
+ */
+int next_access(trace_reader* trace, char* type) {
+    if (trace->binary) {
+        return next_binary_access(trace, type);
+    }
+    return next_text_access(trace, type);
+}
+
+/*
+ * close_trace:
+ * Gives back the memory holding a trace.
+ */
+void close_trace(trace_reader* trace) {
+    if (trace->mapped) {
+        munmap(trace->data, trace->size);
+    }
+    else {
+        free(trace->data);
+    }
+}
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2026 the contributors to this repository
+// Not part of the course materials that csim.c comes from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __csim_trace_h
+#define __csim_trace_h
+
+#include <stddef.h>
+
+/*
+ * Traces come either as Valgrind lackey text, one access per line:
+ *
+ *    I  0400d7d4,8     instruction load
+ *     L 7ff0005c8,8    data load
+ *     S 7ff0005c8,8    data store
+ *     M 0421c7f0,4     data modify
+ *
+ * or in the binary format csim-convert writes: BIN_TRACE_MAGIC, the number
+ * of records as 8 little-endian bytes, then one record per access:
+ *
+ *    byte 0    bits 0-1: op, BIN_OP_L, BIN_OP_S, BIN_OP_M or BIN_OP_I
+ *              bits 2-7: length, or BIN_LEN_VARINT if the length is at
+ *                        least BIN_LEN_VARINT and follows as a varint
+ *    varint    the address minus the last record's address (0 for the
+ *              first), zigzag encoded
+ *
+ * Varints are little-endian groups of 7 bits, the high bit set on every
+ * byte but the last.
+ */
+#define BIN_TRACE_MAGIC     "csimbin1"
+#define BIN_TRACE_MAGIC_LEN 8
+#define BIN_TRACE_HEADER    (BIN_TRACE_MAGIC_LEN + 8)
+#define BIN_OP_L            0
+#define BIN_OP_S            1
+#define BIN_OP_M            2
+#define BIN_OP_I            3
+#define BIN_LEN_VARINT      63
+
+typedef struct trace_reader {
+    char* data;                 // the whole file
+    size_t size;
+    int mapped;                 // data is mapped rather than allocated
+    const char* p;              // next byte to read
+    const char* end;
+    int binary;
+    unsigned long long left;    // records left in a binary trace
+    unsigned long long addr;    // address of the last access
+    unsigned int len;           // length of the last access
+    unsigned long long text_addr; // fields of the last L, S or M line of a
+    unsigned int text_len;        // text trace, kept for lines without them
+} trace_reader;
+
+void open_trace(trace_reader* trace, char* trace_fn);
+int  next_access(trace_reader* trace, char* type);
+void close_trace(trace_reader* trace);
+
+#endif // __csim_trace_h
@@ -57,6 +57,7 @@
  *  hit plus a possible eviction.
  */  
 
+#define _GNU_SOURCE
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -67,6 +68,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include "csim-trace.h"
 
 
 /******************************************************************************/
@@ -244,7 +246,7 @@ void access_data(mem_addr_t addr) {
 			line->valid = 1;
 			miss_cnt++;
 			if (verbosity){
-				printf("%s","miss ");
+				fputs_unlocked("miss ", stdout);
 			}
 			allocated = 1;
 			break;
@@ -279,7 +281,7 @@ void access_data(mem_addr_t addr) {
 			allocated = 1;
 			hit_cnt++;
 			if (verbosity){
-				printf("%s", "hit ");
+				fputs_unlocked("hit ", stdout);
 			}
 			break;
 		}
@@ -296,7 +298,7 @@ void access_data(mem_addr_t addr) {
 		if ((line->tag) == tag && (line->valid) == 1){
 			hit_cnt++;
 			if (verbosity){
-				printf("%s", "hit ");
+				fputs_unlocked("hit ", stdout);
 			}
 		}
 		else{
@@ -305,12 +307,12 @@ void access_data(mem_addr_t addr) {
 			cache[set][set_header->head].tag = tag;
 			miss_cnt++;
 			if (verbosity){
-				printf("%s", "miss ");
+				fputs_unlocked("miss ", stdout);
 			}
 			if (cache[set][set_header->head].valid == 1){
 				evict_cnt++;
 				if (verbosity){
-					printf("%s", "eviction ");
+					fputs_unlocked("eviction ", stdout);
 				}		
 			}
 			cache[set][set_header->head].valid = 1;
@@ -322,59 +324,428 @@ void access_data(mem_addr_t addr) {
 
 
 
+/*
+ * print_access:
+ * Prints "<type> <hex addr>,<len> " like printf("%c %llx,%u ").
+ */
+void print_access(char type, mem_addr_t addr, unsigned int len) {
+    char out[48];
+    char* p = out + sizeof(out);
+
+    *--p = ' ';
+    do {
+        *--p = '0' + len % 10;
+        len /= 10;
+    } while (len > 0);
+    *--p = ',';
+    do {
+        *--p = "0123456789abcdef"[addr & 15];
+        addr >>= 4;
+    } while (addr > 0);
+    *--p = ' ';
+    *--p = type;
+    fwrite_unlocked(p, 1, out + sizeof(out) - p, stdout);
+}
+
 /* TODO - FILL IN THE MISSING CODE
  * replay_trace:
  * Replays the given trace file against the cache.
  *
- * Reads the input trace file line by line.
+ * Reads the input trace, text or binary (see csim-trace.h), access by access.
  * Extracts the type of each memory access : L/S/M
  * TRANSLATE each "L" as a load i.e. 1 memory access
  * TRANSLATE each "S" as a store i.e. 1 memory access
  * TRANSLATE each "M" as a load followed by a store i.e. 2 memory accesses 
+ * Instruction loads (I) are ignored.
  */                    
 void replay_trace(char* trace_fn) {           
-    char buf[1000];  
-    mem_addr_t addr = 0;
-    unsigned int len = 0;
-    FILE* trace_fp = fopen(trace_fn, "r"); 
+    trace_reader trace;
+    char type;
 
-    if (!trace_fp) { 
-        fprintf(stderr, "%s: %s\n", trace_fn, strerror(errno));
-        exit(1);   
-    }
-
-    while (fgets(buf, 1000, trace_fp) != NULL) {
-        if (buf[1] == 'S' || buf[1] == 'L' || buf[1] == 'M') {
-            sscanf(buf+3, "%llx,%u", &addr, &len);
-      
+    open_trace(&trace, trace_fn);
+    init_header();
+    while (next_access(&trace, &type)) {
+        if (type == 'S' || type == 'L' || type == 'M') {
             if (verbosity)
-                printf("%c %llx,%u ", buf[1], addr, len);
-
-            // TODO - MISSING CODE
-            // GIVEN: 1. addr has the address to be accessed
-            //        2. buf[1] has type of acccess(S/L/M)
-            // call access_data function here depending on type of access
-	    init_header();
-	    access_data(addr);
-	    if (buf[1] == 'M'){
-	        access_data(addr);
+                print_access(type, trace.addr, trace.len);
+
+            //Every access starts from the same set order as the first,
+            //which keeps the results of the original replay
+            mem_addr_t set = get_s_bit(trace.addr);
+            headers[set].head = 0;
+            headers[set].tail = E-1;
+	    access_data(trace.addr);
+	    if (type == 'M'){
+	        access_data(trace.addr);
 	    }
             if (verbosity)
-                printf("\n");
+                putchar_unlocked('\n');
         }
     }
     free(headers);
-
-    fclose(trace_fp);
+    close_trace(&trace);
 }  
   
   
+/*
+ * sweep_config_t: One (s, b) pair of a sweep. Each set keeps the blocks of
+ * its max_E most recently used lines, most recent first, which is what an
+ * LRU cache of any E up to max_E holds (Mattson's stack property), so one
+ * pass gives the results for every E.
+ */
+typedef struct sweep_config {
+    int s;
+    int b;
+    mem_addr_t* stacks;        // max_E block numbers per set
+    int* depth;                // blocks on each set's stack
+    unsigned long long* hist;  // accesses at each stack distance below max_E
+    unsigned long long far;    // accesses further down, or first accesses
+} sweep_config_t;
+
+/*
+ * parse_range:
+ * Reads "<lo>" or "<lo>-<hi>" into *lo and *hi.
+ * Returns 0 if the range is not valid or anything follows it.
+ */
+int parse_range(char* arg, int* lo, int* hi) {
+    char* end;
+    long lo_val = strtol(arg, &end, 10);
+    long hi_val = lo_val;
+    if (end == arg) {
+        return 0;
+    }
+    if (*end == '-') {
+        char* start = end + 1;
+        hi_val = strtol(start, &end, 10);
+        if (end == start) {
+            return 0;
+        }
+    }
+    if (*end != '\0' || lo_val < 0 || lo_val > hi_val || hi_val > 63) {
+        return 0;
+    }
+    *lo = lo_val;
+    *hi = hi_val;
+    return 1;
+}
+
+/*
+ * sweep_access:
+ * Finds how far down the stack of its set an access is and moves its
+ * block to the top.
+ */
+void sweep_access(sweep_config_t* config, int max_E, mem_addr_t addr) {
+    mem_addr_t block = addr >> config->b;
+    mem_addr_t set = block & ((1ULL << config->s) - 1);
+    mem_addr_t* stack = config->stacks + set * max_E;
+    int depth = config->depth[set];
+    int d = 0;
+
+    while (d < depth && stack[d] != block) {
+        d++;
+    }
+    if (d < depth) {
+        config->hist[d]++;
+    }
+    else {
+        //A block that is not on the stack pushes the last one off
+        config->far++;
+        if (depth < max_E) {
+            config->depth[set] = ++depth;
+        }
+        d = depth - 1;
+    }
+    memmove(stack + 1, stack, d * sizeof(mem_addr_t));
+    stack[0] = block;
+}
+
+/*
+ * sweep_trace:
+ * Replays the trace once for every s from s_lo to s_hi and b from b_lo to
+ * b_hi at the same time, and prints hits, misses and evictions of an LRU
+ * cache with each of those s and b and every E from 1 to max_E.
+ *
+ * An access hits with E lines if fewer than E other blocks of its set were
+ * used since its block last was. A set only evicts once it is full, which
+ * happens after its first min(E, blocks used in the set) misses.
+ */
+void sweep_trace(char* trace_fn, int s_lo, int s_hi, int b_lo, int b_hi, int max_E) {
+    int num_configs = (s_hi - s_lo + 1) * (b_hi - b_lo + 1);
+    sweep_config_t* configs = malloc(num_configs * sizeof(sweep_config_t));
+    if (configs == NULL) {
+        exit(1);
+    }
+    for (int i = 0; i < num_configs; i++) {
+        configs[i].s = s_lo + i / (b_hi - b_lo + 1);
+        configs[i].b = b_lo + i % (b_hi - b_lo + 1);
+        size_t sets = 1ULL << configs[i].s;
+        configs[i].stacks = malloc(sets * max_E * sizeof(mem_addr_t));
+        configs[i].depth = calloc(sets, sizeof(int));
+        configs[i].hist = calloc(max_E, sizeof(unsigned long long));
+        configs[i].far = 0;
+        if (configs[i].stacks == NULL || configs[i].depth == NULL || configs[i].hist == NULL) {
+            exit(1);
+        }
+    }
+
+    trace_reader trace;
+    char type;
+    open_trace(&trace, trace_fn);
+    while (next_access(&trace, &type)) {
+        if (type == 'S' || type == 'L' || type == 'M') {
+            for (int i = 0; i < num_configs; i++) {
+                sweep_access(&configs[i], max_E, trace.addr);
+                if (type == 'M') {
+                    sweep_access(&configs[i], max_E, trace.addr);
+                }
+            }
+        }
+    }
+    close_trace(&trace);
+
+    printf("%3s %4s %3s %14s %14s %14s\n", "s", "E", "b", "hits", "misses", "evictions");
+    for (int i = 0; i < num_configs; i++) {
+        sweep_config_t* config = &configs[i];
+        unsigned long long total = config->far;
+        for (int d = 0; d < max_E; d++) {
+            total += config->hist[d];
+        }
+        unsigned long long hits = 0;
+        for (int lines = 1; lines <= max_E; lines++) {
+            hits += config->hist[lines - 1];
+            unsigned long long misses = total - hits;
+            unsigned long long fills = 0;
+            for (size_t set = 0; set < (1ULL << config->s); set++) {
+                fills += config->depth[set] < lines ? config->depth[set] : lines;
+            }
+            printf("%3d %4d %3d %14llu %14llu %14llu\n", config->s, lines, config->b,
+                   hits, misses, misses - fills);
+        }
+        free(config->stacks);
+        free(config->depth);
+        free(config->hist);
+    }
+    free(configs);
+}
+
+
+/*
+ * reuse_t: State of a reuse-distance pass. Accesses are numbered from 1 in
+ * trace order. A hash table maps each block to the number of its last
+ * access, and a Fenwick tree over access numbers holds a 1 at the last
+ * access of every block, so the distinct blocks used since a block's last
+ * access are a difference of two prefix sums.
+ */
+typedef struct reuse {
+    mem_addr_t* blocks;          // hash table keys
+    unsigned long long* last;    // last access of each block, 0 if empty
+    size_t capacity;             // a power of two
+    size_t count;
+    unsigned int* tree;          // Fenwick tree, tree[1..tree_size]
+    size_t tree_size;
+    unsigned long long* hist;    // accesses at each reuse distance
+    size_t hist_size;
+    unsigned long long cold;     // first accesses to a block
+    unsigned long long now;      // number of the latest access
+} reuse_t;
+
+void tree_add(reuse_t* reuse, size_t i, int delta) {
+    for (; i <= reuse->tree_size; i += i & -i) {
+        reuse->tree[i] += delta;
+    }
+}
+
+unsigned long long tree_sum(reuse_t* reuse, size_t i) {
+    unsigned long long sum = 0;
+    for (; i > 0; i -= i & -i) {
+        sum += reuse->tree[i];
+    }
+    return sum;
+}
+
+/*
+ * find_block:
+ * Returns the hash table slot of a block, or the empty slot it would take.
+ */
+size_t find_block(reuse_t* reuse, mem_addr_t block) {
+    size_t slot = (block * 0x9E3779B97F4A7C15ULL) >> 32 & (reuse->capacity - 1);
+    while (reuse->last[slot] != 0 && reuse->blocks[slot] != block) {
+        slot = (slot + 1) & (reuse->capacity - 1);
+    }
+    return slot;
+}
+
+/*
+ * grow_reuse:
+ * Doubles the hash table or the tree, whichever is full, and puts every
+ * block back in.
+ */
+void grow_reuse(reuse_t* reuse) {
+    if (2 * (reuse->count + 1) > reuse->capacity) {
+        mem_addr_t* old_blocks = reuse->blocks;
+        unsigned long long* old_last = reuse->last;
+        size_t old_capacity = reuse->capacity;
+
+        reuse->capacity *= 2;
+        reuse->blocks = malloc(reuse->capacity * sizeof(mem_addr_t));
+        reuse->last = calloc(reuse->capacity, sizeof(unsigned long long));
+        if (reuse->blocks == NULL || reuse->last == NULL) {
+            exit(1);
+        }
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_last[i] != 0) {
+                size_t slot = find_block(reuse, old_blocks[i]);
+                reuse->blocks[slot] = old_blocks[i];
+                reuse->last[slot] = old_last[i];
+            }
+        }
+        free(old_blocks);
+        free(old_last);
+    }
+
+    if (reuse->now + 1 > reuse->tree_size) {
+        reuse->tree_size *= 2;
+        free(reuse->tree);
+        reuse->tree = calloc(reuse->tree_size + 1, sizeof(unsigned int));
+        if (reuse->tree == NULL) {
+            exit(1);
+        }
+        for (size_t i = 0; i < reuse->capacity; i++) {
+            if (reuse->last[i] != 0) {
+                tree_add(reuse, reuse->last[i], 1);
+            }
+        }
+    }
+}
+
+/*
+ * reuse_access:
+ * Counts the reuse distance of an access to a block: how many other
+ * blocks were used since its last access.
+ */
+void reuse_access(reuse_t* reuse, mem_addr_t block) {
+    if (2 * (reuse->count + 1) > reuse->capacity || reuse->now + 1 > reuse->tree_size) {
+        grow_reuse(reuse);
+    }
+    size_t slot = find_block(reuse, block);
+    unsigned long long now = ++reuse->now;
+
+    if (reuse->last[slot] == 0) {
+        reuse->blocks[slot] = block;
+        reuse->count++;
+        reuse->cold++;
+    }
+    else {
+        unsigned long long last = reuse->last[slot];
+        size_t distance = tree_sum(reuse, now - 1) - tree_sum(reuse, last);
+        if (distance >= reuse->hist_size) {
+            size_t old_size = reuse->hist_size;
+            while (distance >= reuse->hist_size) {
+                reuse->hist_size *= 2;
+            }
+            reuse->hist = realloc(reuse->hist, reuse->hist_size * sizeof(unsigned long long));
+            if (reuse->hist == NULL) {
+                exit(1);
+            }
+            memset(reuse->hist + old_size, 0, (reuse->hist_size - old_size) * sizeof(unsigned long long));
+        }
+        reuse->hist[distance]++;
+        tree_add(reuse, last, -1);
+    }
+    tree_add(reuse, now, 1);
+    reuse->last[slot] = now;
+}
+
+/*
+ * reuse_trace:
+ * Finds the reuse distance of every access of the trace at the
+ * granularity of 2^b byte blocks and prints how they are distributed.
+ * Writes the miss-ratio curve they give to a CSV file: a fully
+ * associative LRU cache of C blocks misses on first accesses and on
+ * accesses with a reuse distance of at least C. The curve has a row for
+ * every size where the ratio drops, up to the size where only first
+ * accesses miss.
+ */
+void reuse_trace(char* trace_fn, char* csv_fn) {
+    reuse_t reuse;
+    reuse.capacity = 1024;
+    reuse.count = 0;
+    reuse.blocks = malloc(reuse.capacity * sizeof(mem_addr_t));
+    reuse.last = calloc(reuse.capacity, sizeof(unsigned long long));
+    reuse.tree_size = 1024;
+    reuse.tree = calloc(reuse.tree_size + 1, sizeof(unsigned int));
+    reuse.hist_size = 1024;
+    reuse.hist = calloc(reuse.hist_size, sizeof(unsigned long long));
+    reuse.cold = 0;
+    reuse.now = 0;
+    if (reuse.blocks == NULL || reuse.last == NULL || reuse.tree == NULL || reuse.hist == NULL) {
+        exit(1);
+    }
+
+    FILE* csv_fp = fopen(csv_fn, "w");
+    if (!csv_fp) {
+        fprintf(stderr, "%s: %s\n", csv_fn, strerror(errno));
+        exit(1);
+    }
+
+    trace_reader trace;
+    char type;
+    open_trace(&trace, trace_fn);
+    while (next_access(&trace, &type)) {
+        if (type == 'S' || type == 'L' || type == 'M') {
+            reuse_access(&reuse, trace.addr >> b);
+            if (type == 'M') {
+                reuse_access(&reuse, trace.addr >> b);
+            }
+        }
+    }
+    close_trace(&trace);
+
+    //Distances in power-of-two buckets: 0, 1, 2-3, 4-7, ...
+    printf("accesses:%llu blocks:%zu cold:%llu\n", reuse.now, reuse.count, reuse.cold);
+    printf("%-24s %14s\n", "distance", "accesses");
+    for (size_t lo = 0; lo < reuse.hist_size; lo = lo == 0 ? 1 : 2 * lo) {
+        size_t hi = lo == 0 ? 0 : 2 * lo - 1;
+        unsigned long long n = 0;
+        for (size_t d = lo; d <= hi && d < reuse.hist_size; d++) {
+            n += reuse.hist[d];
+        }
+        if (n > 0) {
+            char range[48];
+            snprintf(range, sizeof(range), lo == hi ? "%zu" : "%zu-%zu", lo, hi);
+            printf("%-24s %14llu\n", range, n);
+        }
+    }
+
+    //Misses with C blocks, from the largest distance down
+    unsigned long long misses = reuse.now;
+    fprintf(csv_fp, "cache_blocks,cache_bytes,misses,miss_ratio\n");
+    for (size_t blocks = 1; blocks <= reuse.hist_size && misses > reuse.cold; blocks++) {
+        unsigned long long hits = reuse.hist[blocks - 1];
+        if (hits == 0) {
+            continue;
+        }
+        misses -= hits;
+        fprintf(csv_fp, "%zu,%llu,%llu,%.6f\n", blocks, (unsigned long long)blocks << b,
+                misses, (double)misses / reuse.now);
+    }
+    fclose(csv_fp);
+
+    free(reuse.blocks);
+    free(reuse.last);
+    free(reuse.tree);
+    free(reuse.hist);
+}
+
+
 /*
  * print_usage:
  * Print information on how to use csim to standard output.
  */                    
 void print_usage(char* argv[]) {                 
     printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("       %s -w -s <lo>[-<hi>] -b <lo>[-<hi>] [-E <max>] -t <file>\n", argv[0]);
+    printf("       %s -r <csv> -b <num> -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
@@ -382,10 +753,15 @@ void print_usage(char* argv[]) {
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of b bits for block offsets.\n");
     printf("  -t <file>  Trace file.\n");
+    printf("  -w         Sweep every s and b in the given ranges and every E up to\n");
+    printf("             -E (default 16) in one pass over the trace.\n");
+    printf("  -r <csv>   Print the reuse distances of the trace's blocks and write\n");
+    printf("             the miss-ratio curve of an LRU cache to a CSV file.\n");
     printf("\nExamples:\n");
     printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
-    exit(0);
+    printf("  linux>  %s -w -s 0-8 -b 4-6 -E 32 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -r yi-mrc.csv -b 6 -t traces/yi.trace\n", argv[0]);
 }  
   
   
@@ -409,13 +785,18 @@ void print_summary(int hits, int misses, int evictions) {
  */                    
 int main(int argc, char* argv[]) {                      
     char* trace_file = NULL;
+    char* s_range = NULL;
+    char* b_range = NULL;
+    char* csv_file = NULL;
+    int sweep = 0;
     char c;
     
-    // Parse the command line arguments: -h, -v, -s, -E, -b, -t 
-    while ((c = getopt(argc, argv, "s:E:b:t:vh")) != -1) {
+    // Parse the command line arguments: -h, -v, -s, -E, -b, -t, -w, -r 
+    while ((c = getopt(argc, argv, "s:E:b:t:vhwr:")) != -1) {
         switch (c) {
             case 'b':
                 b = atoi(optarg);
+                b_range = optarg;
                 break;
             case 'E':
                 E = atoi(optarg);
@@ -425,6 +806,7 @@ int main(int argc, char* argv[]) {
                 exit(0);
             case 's':
                 s = atoi(optarg);
+                s_range = optarg;
                 break;
             case 't':
                 trace_file = optarg;
@@ -432,12 +814,50 @@ int main(int argc, char* argv[]) {
             case 'v':
                 verbosity = 1;
                 break;
+            case 'w':
+                sweep = 1;
+                break;
+            case 'r':
+                csv_file = optarg;
+                break;
             default:
                 print_usage(argv);
                 exit(1);
         }
     }
 
+    //A sweep and reuse distances each replace the single simulation
+    if (sweep && csv_file != NULL) {
+        printf("%s: -w and -r cannot be used together\n", argv[0]);
+        print_usage(argv);
+        exit(1);
+    }
+
+    //A sweep takes ranges and replaces the single simulation
+    if (sweep) {
+        int s_lo, s_hi, b_lo, b_hi;
+        if (s_range == NULL || b_range == NULL || trace_file == NULL || E < 0 ||
+            !parse_range(s_range, &s_lo, &s_hi) || !parse_range(b_range, &b_lo, &b_hi) ||
+            s_hi + b_hi > 63) {
+            printf("%s: Missing or invalid command line argument\n", argv[0]);
+            print_usage(argv);
+            exit(1);
+        }
+        sweep_trace(trace_file, s_lo, s_hi, b_lo, b_hi, E > 0 ? E : 16);
+        return 0;
+    }
+
+    //Reuse distances only depend on the block size
+    if (csv_file != NULL) {
+        if (b_range == NULL || trace_file == NULL || b < 0 || b > 63) {
+            printf("%s: Missing or invalid command line argument\n", argv[0]);
+            print_usage(argv);
+            exit(1);
+        }
+        reuse_trace(trace_file, csv_file);
+        return 0;
+    }
+
     //Make sure that all required command line args were specified.
     if (s == 0 || E == 0 || b == 0 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);